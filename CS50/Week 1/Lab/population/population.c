@@ -1,15 +1,73 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <cs50.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+
+// Populations at least this large are close enough to their growth bounds to try jumping ahead
+#define JUMP_THRESHOLD (1L << 20)
+
+// Every population a start size reaches, year by year, as far as any query has needed so far
+typedef struct
+{
+    long start;
+    long *sizes;
+    int length;
+    int capacity;
+}
+trajectory;
+
+// Open-addressing table of trajectories keyed by start size; a start of 0 marks an empty slot
+typedef struct
+{
+    trajectory *slots;
+    int capacity;
+    int count;
+}
+trajectory_cache;
 
 // Function prototypes
 long get_start_size(void);
 long get_end_size(long start);
 long calculate_years(long start, long end);
+__int128 grow(__int128 population);
+bool bracket_years(__int128 start, long end, long *years);
 void print_results(long start, long end, long years);
+int answer_queries(FILE *queries);
+trajectory *find_trajectory(trajectory_cache *cache, long start);
+unsigned long hash_start(long start);
+long years_from(trajectory *path, long end);
 
 // Main function
-int main(void)
+int main(int argc, string argv[])
 {
+    // Answer a file of queries instead of prompting
+    if (argc > 2)
+    {
+        printf("Usage: ./population [queries | -]\n");
+        return 1;
+    }
+    if (argc == 2)
+    {
+        FILE *queries = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "r");
+        if (queries == NULL)
+        {
+            printf("Could not open %s.\n", argv[1]);
+            return 1;
+        }
+        int status = answer_queries(queries);
+        if (queries != stdin)
+        {
+            fclose(queries);
+        }
+        return status;
+    }
+
     // Prompt for start size
     long n1 = get_start_size();
 
@@ -21,6 +79,7 @@ int main(void)
 
     // Print number of years
     print_results(n1, n2, n3);
+    return 0;
 }
 
 // Function for start size
@@ -49,17 +108,200 @@ long get_end_size(long start)
 
 long calculate_years(long start, long end)
 {
-    long i;
-    for (i = 0; start < end; i++)
+    __int128 population = start;
+    long years = 0;
+    while (population < end)
     {
-        long gain = start / 3;
-        long loss = start / 4;
-        start = start + (gain - loss);
+        long remaining;
+        if (population >= JUMP_THRESHOLD && bracket_years(population, end, &remaining))
+        {
+            return years + remaining;
+        }
+        population = grow(population);
+        years++;
     }
-    return i;
+    return years;
+}
+
+// One year of start / 3 births and start / 4 deaths, in 128 bits so populations near
+// LONG_MAX cannot overflow. Writing n as 12q + r leaves a single division
+__int128 grow(__int128 population)
+{
+    static const int GROWTH[12] = {0, 1, 2, 4, 4, 5, 7, 8, 8, 10, 11, 12};
+    __int128 twelfths = population / 12;
+    return 13 * twelfths + GROWTH[population % 12];
+}
+
+// Truncation keeps a year's growth between (13n - 8) / 12 and (13n + 9) / 12, so after k years
+// the population lies between (start - 8)(13/12)^k + 8 and (start + 9)(13/12)^k - 9. When the
+// first year the lower bound reaches end is also the first year the upper bound does, that year
+// is the answer; otherwise, or when the logarithms are too close to call, this returns false
+bool bracket_years(__int128 start, long end, long *years)
+{
+    const long double margin = 1e-9L;
+    long double rate = logl(13.0L / 12.0L);
+    long double lower = logl((end - 8.0L) / ((long double) start - 8.0L)) / rate;
+    long double upper = logl((end + 9.0L) / ((long double) start + 9.0L)) / rate;
+
+    long double first = ceill(lower);
+    if (first - lower < margin || lower - (first - 1) < margin || upper - (first - 1) < margin)
+    {
+        return false;
+    }
+    *years = (long) first;
+    return true;
 }
 
 void print_results(long start, long end, long years)
 {
     printf("Years: %li\n", years);
 }
+
+// Reads one "start end" pair per line and prints start, end and years tab-separated.
+// Pairs the prompts would reject are reported on stderr and skipped
+int answer_queries(FILE *queries)
+{
+    trajectory_cache cache = {calloc(64, sizeof(trajectory)), 64, 0};
+    if (cache.slots == NULL)
+    {
+        fprintf(stderr, "Not enough memory.\n");
+        return 1;
+    }
+
+    int status = 0;
+    char *line = NULL;
+    size_t size = 0;
+    for (long number = 1; getline(&line, &size, queries) >= 0; number++)
+    {
+        // Numbers out of range or anything but whitespace after the end make the line bad
+        char *rest;
+        errno = 0;
+        long start = strtol(line, &rest, 10);
+        bool overflow = errno == ERANGE;
+        char *after = rest;
+        errno = 0;
+        long end = strtol(rest, &after, 10);
+        overflow = overflow || errno == ERANGE;
+        char *junk = after;
+        while (isspace((unsigned char) *junk))
+        {
+            junk++;
+        }
+        if (after == rest || overflow || *junk != '\0' || start < 9 || end <= start)
+        {
+            fprintf(stderr, "Line %li: expected a start of at least 9 and a larger end.\n", number);
+            status = 1;
+            continue;
+        }
+
+        trajectory *path = find_trajectory(&cache, start);
+        if (path == NULL)
+        {
+            fprintf(stderr, "Not enough memory.\n");
+            status = 1;
+            break;
+        }
+        printf("%li\t%li\t%li\n", start, end, years_from(path, end));
+    }
+
+    free(line);
+    for (int i = 0; i < cache.capacity; i++)
+    {
+        free(cache.slots[i].sizes);
+    }
+    free(cache.slots);
+    return status;
+}
+
+// Returns the cached trajectory for start, adding an empty one the first time it is asked for
+trajectory *find_trajectory(trajectory_cache *cache, long start)
+{
+    if (2 * (cache->count + 1) > cache->capacity)
+    {
+        trajectory_cache larger = {calloc(2 * cache->capacity, sizeof(trajectory)), 2 * cache->capacity, cache->count};
+        if (larger.slots == NULL)
+        {
+            return NULL;
+        }
+        for (int i = 0; i < cache->capacity; i++)
+        {
+            if (cache->slots[i].start != 0)
+            {
+                unsigned long j = hash_start(cache->slots[i].start);
+                while (larger.slots[j & (larger.capacity - 1)].start != 0)
+                {
+                    j++;
+                }
+                larger.slots[j & (larger.capacity - 1)] = cache->slots[i];
+            }
+        }
+        free(cache->slots);
+        *cache = larger;
+    }
+
+    for (unsigned long j = hash_start(start);; j++)
+    {
+        trajectory *slot = &cache->slots[j & (cache->capacity - 1)];
+        if (slot->start == start)
+        {
+            return slot;
+        }
+        if (slot->start == 0)
+        {
+            slot->sizes = malloc(16 * sizeof(long));
+            if (slot->sizes == NULL)
+            {
+                return NULL;
+            }
+            slot->start = start;
+            slot->sizes[0] = start;
+            slot->length = 1;
+            slot->capacity = 16;
+            cache->count++;
+            return slot;
+        }
+    }
+}
+
+// Fibonacci hashing; the high bits of the product are the well-mixed ones
+unsigned long hash_start(long start)
+{
+    return ((unsigned long) start * 0x9E3779B97F4A7C15UL) >> 32;
+}
+
+// Extends the trajectory until it reaches end, then binary searches for the first year that does.
+// Sizes past LONG_MAX are stored as LONG_MAX, which already reaches any end
+long years_from(trajectory *path, long end)
+{
+    while (path->sizes[path->length - 1] < end)
+    {
+        if (path->length == path->capacity)
+        {
+            long *larger = realloc(path->sizes, 2 * path->capacity * sizeof(long));
+            if (larger == NULL)
+            {
+                return calculate_years(path->start, end);
+            }
+            path->sizes = larger;
+            path->capacity *= 2;
+        }
+        __int128 next = grow(path->sizes[path->length - 1]);
+        path->sizes[path->length++] = next > LONG_MAX ? LONG_MAX : (long) next;
+    }
+
+    int low = 0;
+    int high = path->length - 1;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (path->sizes[middle] < end)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
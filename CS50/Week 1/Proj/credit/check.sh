@@ -0,0 +1,70 @@
+#!/bin/bash
+
+# Checks the batch kernel against the scalar path: generates card lines of every kind, runs
+# ./credit FILE and ./credit -s FILE on them and fails if any verdict differs.
+# Usage: ./check.sh [lines] [seed]
+
+cd "$(dirname "$0")" || exit 1
+lines=${1:-100000}
+seed=${2:-50}
+
+if ! make -s credit; then
+    echo "Could not build credit."
+    exit 1
+fi
+
+input=$(mktemp)
+vector=$(mktemp)
+scalar=$(mktemp)
+trap 'rm -f "$input" "$vector" "$scalar"' EXIT
+
+# Luhn-valid numbers for each issuer, one digit changed, wrong lengths and prefixes, stray
+# characters, empty lines and CRLF endings
+awk -v lines="$lines" -v seed="$seed" '
+function digits(n,    s) { s = ""; while (n-- > 0) s = s int(rand() * 10); return s }
+function luhn(body,    sum, i, d, n) {
+    sum = 0
+    n = length(body)
+    for (i = n; i >= 1; i--) {
+        d = substr(body, i, 1) + 0
+        if ((n - i) % 2 == 0) { d *= 2; if (d > 9) d -= 9 }
+        sum += d
+    }
+    return body ((10 - sum % 10) % 10)
+}
+BEGIN {
+    srand(seed)
+    split("34 37 4 4 51 55 22 6011 3 5", prefixes, " ")
+    split("15 15 13 16 16 16 16 16 14 17", lengths, " ")
+    for (k = 0; k < lines; k++) {
+        p = 1 + int(rand() * 10)
+        n = lengths[p] + (rand() < 0.1 ? int(rand() * 5) - 2 : 0)
+        n = n < length(prefixes[p]) + 1 ? length(prefixes[p]) + 1 : n
+        line = luhn(prefixes[p] digits(n - length(prefixes[p]) - 1))
+        r = rand()
+        if (r < 0.2) {
+            i = 1 + int(rand() * length(line))
+            line = substr(line, 1, i - 1) int(rand() * 10) substr(line, i + 1)
+        }
+        else if (r < 0.25) {
+            i = 1 + int(rand() * length(line))
+            line = substr(line, 1, i - 1) substr("x- .", 1 + int(rand() * 4), 1) substr(line, i + 1)
+        }
+        else if (r < 0.27) {
+            line = ""
+        }
+        else if (r < 0.3) {
+            line = digits(1 + int(rand() * 20))
+        }
+        printf "%s%s\n", line, rand() < 0.05 ? "\r" : ""
+    }
+}' > "$input"
+
+./credit "$input" > "$vector"
+./credit -s "$input" > "$scalar"
+if ! cmp -s "$vector" "$scalar"; then
+    echo "Batch and scalar verdicts differ:"
+    diff "$vector" "$scalar" | head
+    exit 1
+fi
+echo "$(wc -l < "$input") lines, batch and scalar verdicts agree."
@@ -1,38 +1,360 @@
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <cs50.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Lines checked together by the batch kernels, and the size of the verdict buffer
+#define BATCH_SIZE 32
+#define OUTPUT_SIZE 65536
+
 typedef struct
 {
-    long *card_number;
+    long number;
     int length;
     string bank;
 }
 card;
 
+// One line of a batch file; bank is only provisional until the checksum passes
+typedef struct
+{
+    const char *digits;
+    int length;
+    string bank;
+}
+line;
+
+// Verdicts waiting to be written
+typedef struct
+{
+    char data[OUTPUT_SIZE];
+    size_t used;
+}
+output;
+
+typedef void (*sum_kernel)(const char *base, line *lines, int count);
+
 int check_length(long card_number);
+bool check_sum(long card_number);
+string check_bank(long card_number);
+int check_file(string path, bool scalar);
+string check_line(const char *digits, int length);
+string check_prefix(const char *digits, int length);
+void sum_scalar(const char *base, line *lines, int count);
+void write_verdict(output *out, string verdict);
+sum_kernel select_kernel(bool scalar);
 
-int main(void)
+// Luhn digit sum of a two-digit group, indexed by its value: the tens digit is the doubled one
+static const int PAIR_SUMS[100] =
 {
-    card card;
-    *card.card_number = get_long("Number: ");
-    card.length = check_length(*card.card_number);
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9,
+     2,  3,  4,  5,  6,  7,  8,  9, 10, 11,
+     4,  5,  6,  7,  8,  9, 10, 11, 12, 13,
+     6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+     8,  9, 10, 11, 12, 13, 14, 15, 16, 17,
+     1,  2,  3,  4,  5,  6,  7,  8,  9, 10,
+     3,  4,  5,  6,  7,  8,  9, 10, 11, 12,
+     5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+     7,  8,  9, 10, 11, 12, 13, 14, 15, 16,
+     9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+};
+
+int main(int argc, string argv[])
+{
+    // -s forces the scalar path, the reference the vector one must agree with
+    bool scalar = argc > 1 && strcmp(argv[1], "-s") == 0;
+    if (argc > 3 || (argc == 3 && !scalar))
+    {
+        printf("Usage: ./credit [-s] [file]\n");
+        return 1;
+    }
+    if (argc == (scalar ? 3 : 2))
+    {
+        return check_file(argv[argc - 1], scalar);
+    }
+
+    card candidate;
+    candidate.number = get_long("Number: ");
+    candidate.length = check_length(candidate.number);
+    candidate.bank = check_bank(candidate.number);
+    if (candidate.length == 0 || candidate.bank == NULL || !check_sum(candidate.number))
+    {
+        printf("INVALID\n");
+        return 0;
+    }
+    printf("%s\n", candidate.bank);
+    return 0;
 }
 
-int check_length(long *card_number)
+// Returns 13, 15 or 16 for numbers of those lengths, 0 for anything else
+int check_length(long card_number)
 {
-    int length = 0;
-    while ()
+    if (card_number >= 1000000000000 && card_number < 10000000000000)
     {
-        
+        return 13;
     }
-    if ((length != 13 && card_number[0] != 4) || (length != 15) || (length != 16))
+    if (card_number >= 100000000000000 && card_number < 10000000000000000)
     {
-        return printf("INVLAID\n");
+        return card_number < 1000000000000000 ? 15 : 16;
     }
-    else
+    return 0;
+}
+
+// Luhn's algorithm, consuming two digits per division
+bool check_sum(long card_number)
+{
+    int sum = 0;
+    while (card_number > 0)
+    {
+        sum += PAIR_SUMS[card_number % 100];
+        card_number /= 100;
+    }
+    return sum % 10 == 0;
+}
+
+// Matches the length and leading digits together as ranges of whole numbers
+string check_bank(long card_number)
+{
+    if ((card_number >= 340000000000000 && card_number < 350000000000000) ||
+        (card_number >= 370000000000000 && card_number < 380000000000000))
+    {
+        return "AMEX";
+    }
+    if (card_number >= 5100000000000000 && card_number < 5600000000000000)
+    {
+        return "MASTERCARD";
+    }
+    if ((card_number >= 4000000000000 && card_number < 5000000000000) ||
+        (card_number >= 4000000000000000 && card_number < 5000000000000000))
+    {
+        return "VISA";
+    }
+    return NULL;
+}
+
+// Maps a file of card numbers, one per line, and writes a verdict per line through one buffer
+int check_file(string path, bool scalar)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        printf("Could not open %s.\n", path);
+        return 1;
+    }
+
+    size_t size = info.st_size;
+    const char *base = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : "";
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        printf("Could not map %s.\n", path);
+        return 1;
+    }
+    if (size > 0)
+    {
+        madvise((void *) base, size, MADV_SEQUENTIAL);
+    }
+
+    sum_kernel kernel = select_kernel(scalar);
+    static output out;
+    line batch[BATCH_SIZE];
+    const char *cursor = base;
+    const char *end = base + size;
+    while (cursor < end)
+    {
+        // Lines with the wrong length or prefix are settled here; the rest wait for the kernel
+        int count = 0;
+        while (count < BATCH_SIZE && cursor < end)
+        {
+            const char *newline = memchr(cursor, '\n', end - cursor);
+            const char *stop = newline == NULL ? end : newline;
+            int length = stop - cursor;
+            if (length > 0 && stop[-1] == '\r')
+            {
+                length--;
+            }
+            batch[count++] = (line) {cursor, length, check_prefix(cursor, length)};
+            cursor = stop + 1;
+        }
+
+        kernel(base, batch, count);
+        for (int i = 0; i < count; i++)
+        {
+            write_verdict(&out, batch[i].bank == NULL ? "INVALID" : batch[i].bank);
+        }
+    }
+    fwrite(out.data, 1, out.used, stdout);
+    out.used = 0;
+
+    if (size > 0)
+    {
+        munmap((void *) base, size);
+    }
+    return 0;
+}
+
+// The single-number path: parse the line, then check it exactly as main does
+string check_line(const char *digits, int length)
+{
+    if (length == 0 || length > 18)
+    {
+        return NULL;
+    }
+
+    long card_number = 0;
+    for (int i = 0; i < length; i++)
+    {
+        if (digits[i] < '0' || digits[i] > '9')
+        {
+            return NULL;
+        }
+        card_number = 10 * card_number + (digits[i] - '0');
+    }
+    if (check_length(card_number) == 0 || !check_sum(card_number))
+    {
+        return NULL;
+    }
+    return check_bank(card_number);
+}
+
+// check_bank for a line of text: the issuer its length and first two characters would give
+string check_prefix(const char *digits, int length)
+{
+    if (length == 15 && digits[0] == '3' && (digits[1] == '4' || digits[1] == '7'))
+    {
+        return "AMEX";
+    }
+    if (length == 16 && digits[0] == '5' && digits[1] >= '1' && digits[1] <= '5')
+    {
+        return "MASTERCARD";
+    }
+    if ((length == 13 || length == 16) && digits[0] == '4')
+    {
+        return "VISA";
+    }
+    return NULL;
+}
+
+void sum_scalar(const char *base, line *lines, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (lines[i].bank != NULL)
+        {
+            lines[i].bank = check_line(lines[i].digits, lines[i].length);
+        }
+    }
+}
+
+#if defined(__x86_64__)
+// Loads a line of at most 16 digits right-aligned into 16 bytes, reading backwards from its end
+// unless that would start before the mapping
+__attribute__((target("avx2")))
+static __m128i load_digits(const char *base, line number)
+{
+    if (number.digits + number.length - 16 >= base)
+    {
+        return _mm_loadu_si128((const __m128i *) (number.digits + number.length - 16));
+    }
+    char padded[16] = {0};
+    memcpy(padded + 16 - number.length, number.digits, number.length);
+    return _mm_loadu_si128((const __m128i *) padded);
+}
+
+// Two numbers per 256-bit register, one per 128-bit lane, one digit per byte. Bytes left of a
+// number are masked off, even bytes (every second digit counting from the check digit) are
+// doubled through a shuffle table and the digits of each lane are summed with SAD
+__attribute__((target("avx2")))
+static void sum_avx2(const char *base, line *lines, int count)
+{
+    static const char MASKS[32] =
+    {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    };
+    const __m256i doubled = _mm256_setr_epi8(0, 2, 4, 6, 8, 1, 3, 5, 7, 9, 0, 0, 0, 0, 0, 0,
+                                             0, 2, 4, 6, 8, 1, 3, 5, 7, 9, 0, 0, 0, 0, 0, 0);
+    const __m256i even = _mm256_set1_epi16(0x00FF);
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i nine = _mm256_set1_epi8(9);
+
+    line *pending[BATCH_SIZE];
+    int waiting = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (lines[i].bank != NULL)
+        {
+            pending[waiting++] = &lines[i];
+        }
+    }
+    if (waiting % 2 == 1)
+    {
+        pending[waiting] = pending[waiting - 1];
+        waiting++;
+    }
+
+    for (int i = 0; i < waiting; i += 2)
+    {
+        line *first = pending[i];
+        line *second = pending[i + 1];
+        __m256i mask = _mm256_set_m128i(_mm_loadu_si128((const __m128i *) (MASKS + second->length)),
+                                        _mm_loadu_si128((const __m128i *) (MASKS + first->length)));
+        __m256i digits = _mm256_sub_epi8(_mm256_set_m128i(load_digits(base, *second), load_digits(base, *first)), zero);
+        digits = _mm256_and_si256(digits, mask);
+
+        __m256i digit_bytes = _mm256_cmpeq_epi8(_mm256_max_epu8(digits, nine), nine);
+        __m256i spread = _mm256_blendv_epi8(digits, _mm256_shuffle_epi8(doubled, digits), even);
+        __m256i sums = _mm256_sad_epu8(spread, _mm256_setzero_si256());
+
+        unsigned valid = _mm256_movemask_epi8(digit_bytes);
+        int first_sum = _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1);
+        int second_sum = _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+        if ((valid & 0xFFFF) != 0xFFFF || first_sum % 10 != 0)
+        {
+            first->bank = NULL;
+        }
+        if ((valid >> 16) != 0xFFFF || second_sum % 10 != 0)
+        {
+            second->bank = NULL;
+        }
+    }
+}
+#endif
+
+sum_kernel select_kernel(bool scalar)
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (!scalar && __builtin_cpu_supports("avx2"))
+    {
+        return sum_avx2;
+    }
+#endif
+    return sum_scalar;
+}
+
+void write_verdict(output *out, string verdict)
+{
+    size_t length = strlen(verdict);
+    if (out->used + length + 1 > OUTPUT_SIZE)
     {
-        return length;
+        fwrite(out->data, 1, out->used, stdout);
+        out->used = 0;
     }
+    memcpy(out->data + out->used, verdict, length);
+    out->data[out->used + length] = '\n';
+    out->used += length + 1;
 }
 
 /*
@@ -47,6 +369,6 @@ else:
 if cardnumber:
     4 - Visa
     34/37 - AmEx
-    51-57 - Mastercard
+    51-55 - Mastercard
 ()
 */
@@ -1,14 +1,42 @@
 #include <cs50.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 // Function prototypes
 int userinput(void);
 void pyramid_create(int size);
 
-int main(void)
+int main(int argc, string argv[])
 {
     //TODO: Get user input, int 1-8
-    int n = userinput();
+    // A size given on the command line skips the prompt and its limit, but must be a whole
+    // number small enough that the widest row still fits in an int
+    if (argc > 2)
+    {
+        printf("Usage: ./mario [size]\n");
+        return 1;
+    }
+    int n;
+    if (argc == 2)
+    {
+        char *end;
+        long size = strtol(argv[1], &end, 10);
+        if (*end != '\0' || size <= 0 || size > INT_MAX / 2)
+        {
+            printf("Usage: ./mario [size]\n");
+            return 1;
+        }
+        n = size;
+
+        // Nothing has been printed yet, so small rows can be gathered into large writes
+        setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+    }
+    else
+    {
+        n = userinput();
+    }
 
     //TODO: Define pyramid
     pyramid_create(n);
@@ -25,27 +53,31 @@ int userinput(void)
     return n;
 }
 
+// Keeps a single row buffer and turns row i - 1 into row i by adding one hash on each side and
+// moving the newline, so each row costs three byte writes plus its output
 void pyramid_create(int size)
 {
-    for (int i = 0; i < size; i++)
+    // Widest row: size spaces and hashes, the gap, size hashes and the newline
+    char *row = malloc(2 * (size_t) size + 2);
+    if (row == NULL)
     {
-        for (int j = 0; j < size - i - 1; j++)
-        {
-            printf(" ");
-        }
-
-        for (int j = 0; j < i + 1; j++)
-        {
-            printf("#");
-        }
+        printf("Not enough memory for a pyramid of size %i.\n", size);
+        return;
+    }
 
-            printf(" ");
+    memset(row, ' ', size);
+    row[size - 1] = '#';
+    row[size] = ' ';
+    row[size + 1] = '#';
+    row[size + 2] = '\n';
+    fwrite(row, 1, (size_t) size + 3, stdout);
 
-        for (int j = 0; j < i + 1; j++)
-        {
-            printf("#");
-        }
-
-        printf("\n");
+    for (int i = 1; i < size; i++)
+    {
+        row[size - i - 1] = '#';
+        row[size + i + 1] = '#';
+        row[size + i + 2] = '\n';
+        fwrite(row, 1, (size_t) size + i + 3, stdout);
     }
+    free(row);
 }
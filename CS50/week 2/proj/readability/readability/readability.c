@@ -1,78 +1,641 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <cs50.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../../../../../input.h"
+
+#define CHUNK_SIZE 65536
+#define LABEL_SIZE 16
+#define MAX_THREADS 256
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+typedef struct
+{
+    long letters;
+    long words;
+    long sentences;
+}
+counts;
+
+// One worker's slice of a file and the partial counts it produced
+typedef struct
+{
+    int fd;
+    off_t start;
+    off_t end;
+    counts totals;
+    bool read;
+}
+range;
+
+// A file scored in batch mode
+typedef struct
+{
+    string path;
+    int grade;
+    bool read;
+}
+document;
+
+// Documents shared by the batch workers, which claim them one at a time through next
+typedef struct
+{
+    document *documents;
+    int count;
+    int next;
+}
+batch;
 
-string get_text(void);
-int count_letters(string text);
-int count_words(string text);
-int count_sentences(string text);
-int coleman_Liau_index(int letters, int words, int sentences);
+typedef void (*count_kernel)(const char *buffer, size_t length, counts *totals);
+
+void print_usage(void);
+string get_text(reader *in);
+counts count_text(string text);
+bool count_stream(FILE *stream, counts *totals);
+bool count_file(int fd, off_t size, int threads, counts *totals);
+void *count_range(void *arg);
+int score_batch(string source, string format, int threads);
+int compare_paths(const void *a, const void *b);
+string *list_documents(string source, int *count, reader *in);
+void *score_documents(void *arg);
+void print_batch(document *documents, int count, string format);
+void print_path(string path, bool json);
+void count_buffer(const char *buffer, size_t length, counts *totals);
+count_kernel select_kernel(void);
+int coleman_Liau_index(long letters, long words, long sentences);
+void format_grade(int grade, char label[LABEL_SIZE]);
 void return_grade(int grade);
 
-int main(void)
+count_kernel kernel;
+
+int main(int argc, string argv[])
 {
-    string text = get_text();
-    int letters = count_letters(text);
-    int words = count_words(text);
-    int sentences = count_sentences(text);
-    int grade = coleman_Liau_index(letters, words, sentences);
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    string source = NULL;
+    string format = "tsv";
+    int option;
+    while ((option = getopt(argc, argv, "j:b:f:")) != -1)
+    {
+        if (option == 'j' && (threads = atoi(optarg)) >= 1)
+        {
+            continue;
+        }
+        else if (option == 'b')
+        {
+            source = optarg;
+        }
+        else if (option == 'f' && (strcmp(optarg, "tsv") == 0 || strcmp(optarg, "json") == 0))
+        {
+            format = optarg;
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+    if (argc - optind > (source == NULL ? 1 : 0))
+    {
+        print_usage();
+        return 1;
+    }
+
+    kernel = select_kernel();
+    if (source != NULL)
+    {
+        return score_batch(source, format, threads);
+    }
+
+    counts totals;
+    if (optind < argc)
+    {
+        string path = argv[optind];
+        FILE *stream = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+        if (stream == NULL)
+        {
+            printf("Could not open %s.\n", path);
+            return 1;
+        }
+
+        // Regular files can be split across threads; pipes and terminals are read in order
+        totals = (counts) {0, 1, 0};
+        struct stat info;
+        bool read;
+        if (threads > 1 && fstat(fileno(stream), &info) == 0 && S_ISREG(info.st_mode))
+        {
+            read = count_file(fileno(stream), info.st_size, threads, &totals);
+        }
+        else
+        {
+            read = count_stream(stream, &totals);
+        }
+        if (stream != stdin)
+        {
+            fclose(stream);
+        }
+        if (!read)
+        {
+            printf("Could not read %s.\n", path);
+            return 1;
+        }
+    }
+    else
+    {
+        reader in = {0};
+        string text = get_text(&in);
+        if (text == NULL)
+        {
+            reader_free(&in);
+            return 1;
+        }
+        totals = count_text(text);
+        reader_free(&in);
+    }
+
+    int grade = coleman_Liau_index(totals.letters, totals.words, totals.sentences);
     return_grade(grade);
     return 0;
 }
 
-string get_text(void)
+void print_usage(void)
 {
-    string text = get_string("Text: ");
+    printf("Usage: ./readability [-j threads] [file | -]\n");
+    printf("       ./readability [-j threads] [-f tsv | json] -b directory | manifest\n");
+}
+
+string get_text(reader *in)
+{
+    string text = read_string(in, "Text: ");
     return text;
 }
 
-int count_letters(string text)
+// Typed text keeps the prompt's original rule that only spaces end words. The line ending is
+// already gone, but tabs and the like are not, so they are taken back out of the word count
+counts count_text(string text)
+{
+    counts totals = {0, 1, 0};
+    count_buffer(text, strlen(text), &totals);
+    for (string c = strpbrk(text, "\t\n\v\f\r"); c != NULL; c = strpbrk(c + 1, "\t\n\v\f\r"))
+    {
+        totals.words--;
+    }
+    return totals;
+}
+
+// Counts the stream in fixed-size chunks, so memory use does not depend on its length.
+// Every counter is per byte (a word is one more than the number of whitespace bytes), so nothing
+// carries over from one chunk to the next
+bool count_stream(FILE *stream, counts *totals)
+{
+    static _Thread_local char chunk[CHUNK_SIZE];
+    size_t length;
+    while ((length = fread(chunk, 1, CHUNK_SIZE, stream)) > 0)
+    {
+        count_buffer(chunk, length, totals);
+    }
+    return !ferror(stream);
+}
+
+// Splits the file into one contiguous range per thread and adds up their partial counts.
+// Partials start from zero words and totals already holds the one extra word, so a word
+// or sentence cut by a range boundary is counted exactly once, as in count_stream
+bool count_file(int fd, off_t size, int threads, counts *totals)
 {
-    int length = strlen(text);
-    int letters = 0;
+    if (threads > size / CHUNK_SIZE + 1)
+    {
+        threads = size / CHUNK_SIZE + 1;
+    }
+    threads = threads < MAX_THREADS ? threads : MAX_THREADS;
+
+    range *parts = malloc(threads * sizeof(range));
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    if (parts == NULL || workers == NULL)
+    {
+        free(parts);
+        free(workers);
+        return false;
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        parts[i] = (range) {fd, size * i / threads, size * (i + 1) / threads, {0, 0, 0}, true};
+    }
+
+    // Ranges that could not get a thread of their own are counted on this one
+    int started = 0;
+    while (started < threads && pthread_create(&workers[started], NULL, count_range, &parts[started]) == 0)
+    {
+        started++;
+    }
+    for (int i = started; i < threads; i++)
+    {
+        count_range(&parts[i]);
+    }
 
-    for (int i = 0; i < length; i++)
+    bool read = true;
+    for (int i = 0; i < threads; i++)
     {
-        if ((text[i] >= 'a' && text[i] <= 'z') || (text[i] >= 'A' && text[i] <= 'Z'))
+        if (i < started)
         {
-            letters++;
+            pthread_join(workers[i], NULL);
         }
+        totals->letters += parts[i].totals.letters;
+        totals->words += parts[i].totals.words;
+        totals->sentences += parts[i].totals.sentences;
+        read = read && parts[i].read;
     }
-    return letters;
+    free(parts);
+    free(workers);
+    return read;
 }
 
-int count_words(string text)
+void *count_range(void *arg)
 {
-    int length = strlen(text);
-    int words = 1;
+    range *part = arg;
+    char *chunk = malloc(CHUNK_SIZE);
+    if (chunk == NULL)
+    {
+        part->read = false;
+        return NULL;
+    }
 
-    for (int i = 0; i < length; i++)
+    for (off_t offset = part->start; offset < part->end;)
     {
-        if (text[i] == ' ')
+        size_t length = part->end - offset < CHUNK_SIZE ? part->end - offset : CHUNK_SIZE;
+        ssize_t bytes = pread(part->fd, chunk, length, offset);
+        if (bytes <= 0)
         {
-            words++;
+            part->read = false;
+            break;
         }
+        count_buffer(chunk, bytes, &part->totals);
+        offset += bytes;
     }
-    return words;
+    free(chunk);
+    return NULL;
 }
 
-int count_sentences(string text)
+// Scores every file in a directory, or every path listed one per line in a manifest,
+// with the files spread over the threads and results printed in listing order
+int score_batch(string source, string format, int threads)
 {
-    int length = strlen(text);
-    int sentences = 0;
+    int count;
+    reader in = {0};
+    string *paths = list_documents(source, &count, &in);
+    if (paths == NULL)
+    {
+        printf("Could not read %s.\n", source);
+        return 1;
+    }
 
-    for (int i = 0; i < length; i++)
+    document *documents = malloc(count * sizeof(document));
+    if (documents == NULL && count > 0)
     {
-        if (text[i] == '.' || text[i] == '?' || text[i] == '!' )
+        printf("Not enough memory for %i documents.\n", count);
+        reader_free(&in);
+        free(paths);
+        return 1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        documents[i] = (document) {paths[i], 0, false};
+    }
+
+    if (threads > count)
+    {
+        threads = count > 0 ? count : 1;
+    }
+    threads = threads < MAX_THREADS ? threads : MAX_THREADS;
+    batch work = {documents, count, 0};
+
+    // Without room for workers every document is scored on this thread
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+    while (workers != NULL && started < threads - 1 && pthread_create(&workers[started], NULL, score_documents, &work) == 0)
+    {
+        started++;
+    }
+    score_documents(&work);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    print_batch(documents, count, format);
+
+    bool read = true;
+    for (int i = 0; i < count; i++)
+    {
+        read = read && documents[i].read;
+    }
+    reader_free(&in);
+    free(paths);
+    free(documents);
+    free(workers);
+    return read ? 0 : 1;
+}
+
+int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(const string *) a, *(const string *) b);
+}
+
+// Returns the regular files of a directory sorted by name, or the non-empty lines of a manifest.
+// The paths themselves are kept in the reader's arena
+string *list_documents(string source, int *count, reader *in)
+{
+    int capacity = 64;
+    string *paths = malloc(capacity * sizeof(string));
+    if (paths == NULL)
+    {
+        return NULL;
+    }
+    *count = 0;
+
+    DIR *directory = opendir(source);
+    FILE *manifest = directory == NULL ? fopen(source, "r") : NULL;
+    if (directory == NULL && manifest == NULL)
+    {
+        free(paths);
+        return NULL;
+    }
+
+    bool failed = false;
+    while (true)
+    {
+        string path;
+        if (directory != NULL)
+        {
+            struct dirent *entry = readdir(directory);
+            if (entry == NULL)
+            {
+                break;
+            }
+
+            struct stat info;
+            char candidate[strlen(source) + strlen(entry->d_name) + 2];
+            sprintf(candidate, "%s/%s", source, entry->d_name);
+            if (stat(candidate, &info) != 0 || !S_ISREG(info.st_mode))
+            {
+                continue;
+            }
+            path = arena_copy(&in->strings, candidate, strlen(candidate));
+        }
+        else
+        {
+            string line = read_line(in, manifest);
+            if (line == NULL)
+            {
+                break;
+            }
+            if (line[0] == '\0')
+            {
+                continue;
+            }
+            path = arena_copy(&in->strings, line, strlen(line));
+        }
+
+        // A partial list would score only part of the corpus and still succeed
+        if (path == NULL)
+        {
+            failed = true;
+            break;
+        }
+        if (*count == capacity)
+        {
+            string *larger = realloc(paths, 2 * capacity * sizeof(string));
+            if (larger == NULL)
+            {
+                failed = true;
+                break;
+            }
+            paths = larger;
+            capacity *= 2;
+        }
+        paths[(*count)++] = path;
+    }
+
+    if (directory != NULL)
+    {
+        closedir(directory);
+        qsort(paths, *count, sizeof(string), compare_paths);
+    }
+    else
+    {
+        fclose(manifest);
+    }
+    if (failed)
+    {
+        free(paths);
+        return NULL;
+    }
+    return paths;
+}
+
+// Each worker reuses its own chunk buffer (see count_stream) for every document it claims
+void *score_documents(void *arg)
+{
+    batch *work = arg;
+    int i;
+    while ((i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED)) < work->count)
+    {
+        document *doc = &work->documents[i];
+        FILE *stream = fopen(doc->path, "r");
+        if (stream == NULL)
+        {
+            continue;
+        }
+
+        counts totals = {0, 1, 0};
+        doc->read = count_stream(stream, &totals);
+        doc->grade = coleman_Liau_index(totals.letters, totals.words, totals.sentences);
+        fclose(stream);
+    }
+    return NULL;
+}
+
+void print_batch(document *documents, int count, string format)
+{
+    bool json = strcmp(format, "json") == 0;
+    if (json)
+    {
+        printf("[\n");
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        char label[LABEL_SIZE];
+        if (documents[i].read)
+        {
+            format_grade(documents[i].grade, label);
+        }
+        else
+        {
+            strcpy(label, "Error");
+        }
+
+        if (!json)
+        {
+            print_path(documents[i].path, json);
+            printf("\t%s\n", label);
+            continue;
+        }
+
+        printf("  {\"file\": \"");
+        print_path(documents[i].path, json);
+        printf("\", \"grade\": \"%s\"}%s\n", label, i < count - 1 ? "," : "");
+    }
+
+    if (json)
+    {
+        printf("]\n");
+    }
+}
+
+// Escapes a path so it stays one field: backslash, tab, newline and carriage return become \\,
+// \t, \n and \r in both formats, and JSON also escapes quotes and other control characters
+void print_path(string path, bool json)
+{
+    for (string c = path; *c != '\0'; c++)
+    {
+        if (*c == '\\' || (json && *c == '"'))
+        {
+            printf("\\%c", *c);
+        }
+        else if (*c == '\t' || *c == '\n' || *c == '\r')
+        {
+            printf("\\%c", *c == '\t' ? 't' : *c == '\n' ? 'n' : 'r');
+        }
+        else if (json && (unsigned char) *c < 0x20)
+        {
+            printf("\\u%04x", *c);
+        }
+        else
+        {
+            putchar(*c);
+        }
+    }
+}
+
+// Adds the letters, whitespace bytes and sentence marks in buffer to totals. Newlines, tabs and
+// carriage returns end words just as spaces do, so a text reads the same one sentence per line
+void count_buffer(const char *buffer, size_t length, counts *totals)
+{
+    kernel(buffer, length, totals);
+}
+
+static void count_scalar(const char *buffer, size_t length, counts *totals)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = buffer[i];
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+        {
+            totals->letters++;
+        }
+        else if (c == ' ' || (c >= '\t' && c <= '\r'))
+        {
+            totals->words++;
+        }
+        else if (c == '.' || c == '?' || c == '!')
         {
-            sentences++;
+            totals->sentences++;
         }
     }
-    return sentences;
 }
 
-int coleman_Liau_index(int letters, int words, int sentences)
+#if defined(__x86_64__)
+// Setting bit 0x20 folds 'A'..'Z' onto 'a'..'z' without moving any other byte into that range,
+// so one pair of signed compares classifies letters; bytes >= 0x80 compare as negative. Another
+// pair finds '\t'..'\r', the whitespace other than ' '
+static void count_sse2(const char *buffer, size_t length, counts *totals)
+{
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i before_a = _mm_set1_epi8('a' - 1);
+    const __m128i after_z = _mm_set1_epi8('z' + 1);
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i before_tab = _mm_set1_epi8('\t' - 1);
+    const __m128i after_return = _mm_set1_epi8('\r' + 1);
+    const __m128i period = _mm_set1_epi8('.');
+    const __m128i question = _mm_set1_epi8('?');
+    const __m128i exclamation = _mm_set1_epi8('!');
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) (buffer + i));
+        __m128i folded = _mm_or_si128(chunk, case_bit);
+        __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(folded, before_a), _mm_cmplt_epi8(folded, after_z));
+        __m128i spaces = _mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+                                      _mm_and_si128(_mm_cmpgt_epi8(chunk, before_tab), _mm_cmplt_epi8(chunk, after_return)));
+        __m128i marks = _mm_or_si128(_mm_cmpeq_epi8(chunk, period),
+                                     _mm_or_si128(_mm_cmpeq_epi8(chunk, question), _mm_cmpeq_epi8(chunk, exclamation)));
+
+        totals->letters += __builtin_popcount(_mm_movemask_epi8(letters));
+        totals->words += __builtin_popcount(_mm_movemask_epi8(spaces));
+        totals->sentences += __builtin_popcount(_mm_movemask_epi8(marks));
+    }
+    count_scalar(buffer + i, length - i, totals);
+}
+
+__attribute__((target("avx2,popcnt")))
+static void count_avx2(const char *buffer, size_t length, counts *totals)
+{
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i before_a = _mm256_set1_epi8('a' - 1);
+    const __m256i after_z = _mm256_set1_epi8('z' + 1);
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i before_tab = _mm256_set1_epi8('\t' - 1);
+    const __m256i after_return = _mm256_set1_epi8('\r' + 1);
+    const __m256i period = _mm256_set1_epi8('.');
+    const __m256i question = _mm256_set1_epi8('?');
+    const __m256i exclamation = _mm256_set1_epi8('!');
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *) (buffer + i));
+        __m256i folded = _mm256_or_si256(chunk, case_bit);
+        __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(folded, before_a), _mm256_cmpgt_epi8(after_z, folded));
+        __m256i spaces = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space),
+                                         _mm256_and_si256(_mm256_cmpgt_epi8(chunk, before_tab),
+                                                          _mm256_cmpgt_epi8(after_return, chunk)));
+        __m256i marks = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, period),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, question), _mm256_cmpeq_epi8(chunk, exclamation)));
+
+        totals->letters += __builtin_popcount((unsigned) _mm256_movemask_epi8(letters));
+        totals->words += __builtin_popcount((unsigned) _mm256_movemask_epi8(spaces));
+        totals->sentences += __builtin_popcount((unsigned) _mm256_movemask_epi8(marks));
+    }
+    count_sse2(buffer + i, length - i, totals);
+}
+#endif
+
+// Picks the widest counting kernel this CPU supports
+count_kernel select_kernel(void)
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    {
+        return count_avx2;
+    }
+    return count_sse2;
+#else
+    return count_scalar;
+#endif
+}
+
+int coleman_Liau_index(long letters, long words, long sentences)
 {
     float average_letters = ((float) letters / words ) * 100;
     float average_sentences = ((float) sentences / words  ) * 100;
@@ -80,18 +643,25 @@ int coleman_Liau_index(int letters, int words, int sentences)
     return (int) round(index);
 }
 
-void return_grade(int grade)
+void format_grade(int grade, char label[LABEL_SIZE])
 {
     if (grade < 1)
     {
-        printf("Before Grade 1\n");
+        snprintf(label, LABEL_SIZE, "Before Grade 1");
     }
     else if (grade > 16)
     {
-        printf("Grade 16+\n");
+        snprintf(label, LABEL_SIZE, "Grade 16+");
     }
-    else if (grade >= 1 && grade <= 16)
+    else
     {
-        printf("Grade %i\n", grade);
+        snprintf(label, LABEL_SIZE, "Grade %i", grade);
     }
 }
+
+void return_grade(int grade)
+{
+    char label[LABEL_SIZE];
+    format_grade(grade, label);
+    printf("%s\n", label);
+}
@@ -1,127 +1,526 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <cs50.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../../../../input.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Words longer than this are scored 32 bytes at a time
+#define LONG_WORD 64
+
+// Simulated players draw words of 1 to RACK_SIZE random letters
+#define RACK_SIZE 7
+
+// Word lists are split into shards of at least 4096 bytes, one per thread, up to MAX_THREADS
+#define MAX_THREADS 256
+
+// Players by their scores alone: a word is dropped once it is scored, so finding the winner only
+// walks the scores
+typedef struct
+{
+    int count;
+    int *scores;
+}
+roster;
 
+// A word of a word list, identified by where it starts in the mapped file
 typedef struct
 {
-    int player_number;
-    string word;
     int score;
+    size_t offset;
+    size_t length;
 }
-player;
+entry;
 
+// One thread's share of a word list and the best entries it has seen so far
+typedef struct
+{
+    const char *words;
+    size_t start;
+    size_t end;
+    entry *top;
+    int count;
+    int k;
+}
+shard;
+
+typedef int (*score_kernel)(const char *word, size_t length);
+
+void print_usage(void);
+int play_game(int players);
+int simulate(int players, long rounds);
+int find_winner(const int *scores, int count);
+unsigned long next_random(unsigned long *state);
 int calc_score(string word);
+int score_bytes(const char *word, size_t length);
+int rank_words(string path, int k, int threads);
+void *rank_shard(void *arg);
+void push_top(entry *top, int *count, int k, entry candidate);
+bool ranks_below(entry a, entry b);
+int compare_entries(const void *a, const void *b);
+score_kernel select_kernel(void);
+
+// Points per byte; anything that is not a scored letter is worth nothing
+static const int POINTS[256] =
+{
+    ['A'] = 1, ['E'] = 1, ['I'] = 1, ['L'] = 1, ['N'] = 1, ['O'] = 1, ['R'] = 1, ['S'] = 1, ['T'] = 1, ['U'] = 1,
+    ['a'] = 1, ['e'] = 1, ['i'] = 1, ['l'] = 1, ['n'] = 1, ['o'] = 1, ['r'] = 1, ['s'] = 1, ['t'] = 1, ['u'] = 1,
+    ['D'] = 2, ['G'] = 2, ['d'] = 2, ['g'] = 2,
+    ['B'] = 3, ['C'] = 3, ['M'] = 3, ['P'] = 3, ['b'] = 3, ['c'] = 3, ['m'] = 3, ['p'] = 3,
+    ['H'] = 4, ['V'] = 4, ['W'] = 4, ['Y'] = 4, ['h'] = 4, ['v'] = 4, ['w'] = 4, ['y'] = 4,
+    ['K'] = 5, ['k'] = 5,
+    ['J'] = 8, ['X'] = 8, ['j'] = 8, ['x'] = 8,
+    ['Q'] = 10, ['Z'] = 10, ['q'] = 10, ['z'] = 10,
+};
+
+score_kernel kernel;
 
-int main(void)
+int main(int argc, string argv[])
 {
+    string path = NULL;
+    int k = 10;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
     int players = 2;
-    player playerarray[players];
+    long rounds = 0;
+    int option;
+    while ((option = getopt(argc, argv, "d:k:j:p:s:")) != -1)
+    {
+        if (option == 'd')
+        {
+            path = optarg;
+        }
+        else if (option == 'k' && (k = atoi(optarg)) >= 1)
+        {
+            continue;
+        }
+        else if (option == 'j' && (threads = atoi(optarg)) >= 1)
+        {
+            continue;
+        }
+        else if (option == 'p' && (players = atoi(optarg)) >= 1)
+        {
+            continue;
+        }
+        else if (option == 's' && (rounds = atol(optarg)) >= 1)
+        {
+            continue;
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
 
-    for (int i = 0; i < players; i++)
+    kernel = select_kernel();
+    if (path != NULL)
     {
-        playerarray[i].player_number = i + 1;
-        playerarray[i].score = 0;
-        playerarray[i].word = get_string("player %i: ", playerarray[i].player_number);
-        playerarray[i].score = calc_score(playerarray[i].word);
+        return rank_words(path, k, threads);
     }
 
-    if (playerarray[0].score > playerarray[1].score)
+    if (rounds > 0)
     {
-        printf("player 1 wins!\n");
+        return simulate(players, rounds);
     }
-    else if (playerarray[1].score > playerarray[0].score)
+    return play_game(players);
+}
+
+void print_usage(void)
+{
+    printf("Usage: ./scrabble [-p players [-s rounds]]\n");
+    printf("       ./scrabble -d wordlist [-k count] [-j threads]\n");
+}
+
+int play_game(int players)
+{
+    roster game = {players, malloc(players * sizeof(int))};
+    if (game.scores == NULL)
     {
-        printf("Player 2 wins!\n");
+        printf("Not enough memory for %i players.\n", players);
+        return 1;
     }
-    else
+
+    // Each word is a record of its own, so the arena never holds more than the longest one
+    reader in = {0};
+    for (int i = 0; i < game.count; i++)
+    {
+        string word = read_string(&in, "Player %i: ", i + 1);
+        game.scores[i] = word == NULL ? 0 : calc_score(word);
+        reader_reset(&in);
+    }
+
+    int winner = find_winner(game.scores, game.count);
+    if (winner < 0)
     {
         printf("Tie!\n");
     }
+    else
+    {
+        printf("Player %i wins!\n", winner + 1);
+    }
+
+    reader_free(&in);
+    free(game.scores);
+    return 0;
+}
+
+// Plays rounds of random words and reports how often each player won outright
+int simulate(int players, long rounds)
+{
+    int *scores = malloc(players * sizeof(int));
+    long *wins = calloc(players, sizeof(long));
+    if (scores == NULL || wins == NULL)
+    {
+        printf("Not enough memory for %i players.\n", players);
+        return 1;
+    }
+
+    unsigned long state = 0x9E3779B97F4A7C15;
+    char word[RACK_SIZE];
+    long ties = 0;
+    for (long round = 0; round < rounds; round++)
+    {
+        for (int i = 0; i < players; i++)
+        {
+            int length = 1 + next_random(&state) % RACK_SIZE;
+            for (int j = 0; j < length; j++)
+            {
+                word[j] = 'a' + next_random(&state) % 26;
+            }
+            scores[i] = score_bytes(word, length);
+        }
+
+        int winner = find_winner(scores, players);
+        if (winner < 0)
+        {
+            ties++;
+        }
+        else
+        {
+            wins[winner]++;
+        }
+    }
+
+    for (int i = 0; i < players; i++)
+    {
+        printf("Player %i: %li wins\n", i + 1, wins[i]);
+    }
+    printf("Ties: %li\n", ties);
+
+    free(scores);
+    free(wins);
+    return 0;
+}
+
+// Returns the index of the highest score, or -1 when two or more players share it
+int find_winner(const int *scores, int count)
+{
+    int best = 0;
+    bool tied = false;
+    for (int i = 1; i < count; i++)
+    {
+        if (scores[i] > scores[best])
+        {
+            best = i;
+            tied = false;
+        }
+        else if (scores[i] == scores[best])
+        {
+            tied = true;
+        }
+    }
+    return tied ? -1 : best;
+}
+
+// xorshift64, good enough to deal simulated words
+unsigned long next_random(unsigned long *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
 }
 
 int calc_score(string word)
 {
     int score = 0;
 
-    for (int i = 0; i < (int) strlen(word); i++)
-    {
-        switch(word[i])
-        {
-            case 'a'  :
-            case 'A'  :
-            case 'e'  :
-            case 'E'  :
-            case 'i'  :
-            case 'I'  :
-            case 'l'  :
-            case 'L'  :
-            case 'n'  :
-            case 'N'  :
-            case 'o'  :
-            case 'O'  :
-            case 'r'  :
-            case 'R'  :
-            case 's'  :
-            case 'S'  :
-            case 't'  :
-            case 'T'  :
-            case 'u'  :
-            case 'U'  :
-                score++;
-                break;
-
-            case 'd'   :
-            case 'D'   :
-            case 'g'   :
-            case 'G'   :
-                score += 2;
-                break;
-
-            case 'b'   :
-            case 'B'   :
-            case 'c'   :
-            case 'C'   :
-            case 'm'   :
-            case 'M'   :
-            case 'p'   :
-            case 'P'   :
-                score += 3;
-                break;
-
-            case 'h'   :
-            case 'H'   :
-            case 'v'   :
-            case 'V'   :
-            case 'y'   :
-            case 'Y'   :
-            case 'w'   :
-            case 'W'   :
-                score +=4 ;
-                break;
-
-            case 'k'   :
-            case 'K'   :
-                score += 5;
-                break;
-
-            case 'j' :
-            case 'J' :
-            case 'x' :
-            case 'X' :
-                score += 8;
-                break;
-
-            case 'q' :
-            case 'Q' :
-            case 'z' :
-            case 'Z' :
-                score += 10;
-                break;
-
-            default:
-                score += 0;
-                break;
+    // Short words are scored straight from the table; only long ones pay for strlen
+    for (int i = 0; i < LONG_WORD; i++)
+    {
+        if (word[i] == '\0')
+        {
+            return score;
         }
+        score += POINTS[(unsigned char) word[i]];
+    }
+    return score + kernel(word + LONG_WORD, strlen(word + LONG_WORD));
+}
+
+// Scores length bytes that need not be NUL-terminated, as calc_score would
+int score_bytes(const char *word, size_t length)
+{
+    if (length <= LONG_WORD)
+    {
+        int score = 0;
+        for (size_t i = 0; i < length; i++)
+        {
+            score += POINTS[(unsigned char) word[i]];
+        }
+        return score;
+    }
+    return kernel(word, length);
+}
+
+// Maps the word list, scores one line per word across the threads and prints the k best,
+// highest score first and earlier lines first among equal scores
+int rank_words(string path, int k, int threads)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        printf("Could not open %s.\n", path);
+        return 1;
+    }
+
+    size_t size = info.st_size;
+    const char *words = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : "";
+    close(fd);
+    if (words == MAP_FAILED)
+    {
+        printf("Could not map %s.\n", path);
+        return 1;
+    }
+
+    if ((size_t) threads > size / 4096 + 1)
+    {
+        threads = size / 4096 + 1;
+    }
+    threads = threads < MAX_THREADS ? threads : MAX_THREADS;
+    shard *shards = malloc(threads * sizeof(shard));
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    entry *top = malloc((size_t) threads * k * sizeof(entry));
+    if (shards == NULL || workers == NULL || top == NULL)
+    {
+        printf("Not enough memory for %i words per thread.\n", k);
+        free(shards);
+        free(workers);
+        free(top);
+        if (size > 0)
+        {
+            munmap((void *) words, size);
+        }
+        return 1;
+    }
+
+    // Each shard starts on the line after its nominal start, so no line is split or scored twice
+    for (int i = 0; i < threads; i++)
+    {
+        size_t start = size * i / threads;
+        while (start > 0 && start < size && words[start - 1] != '\n')
+        {
+            start++;
+        }
+        shards[i] = (shard) {words, start, size, top + (size_t) i * k, 0, k};
+        if (i > 0)
+        {
+            shards[i - 1].end = start;
+        }
+    }
+
+    int started = 0;
+    while (started < threads && pthread_create(&workers[started], NULL, rank_shard, &shards[started]) == 0)
+    {
+        started++;
+    }
+    for (int i = started; i < threads; i++)
+    {
+        rank_shard(&shards[i]);
+    }
+
+    int count = 0;
+    for (int i = 0; i < threads; i++)
+    {
+        if (i < started)
+        {
+            pthread_join(workers[i], NULL);
+        }
+        memmove(top + count, shards[i].top, shards[i].count * sizeof(entry));
+        count += shards[i].count;
+    }
+
+    qsort(top, count, sizeof(entry), compare_entries);
+    for (int i = 0; i < count && i < k; i++)
+    {
+        printf("%i\t%.*s\n", top[i].score, (int) top[i].length, words + top[i].offset);
+    }
+
+    free(shards);
+    free(workers);
+    free(top);
+    if (size > 0)
+    {
+        munmap((void *) words, size);
+    }
+    return 0;
+}
+
+void *rank_shard(void *arg)
+{
+    shard *part = arg;
+    size_t offset = part->start;
+    while (offset < part->end)
+    {
+        const char *newline = memchr(part->words + offset, '\n', part->end - offset);
+        size_t stop = newline == NULL ? part->end : (size_t) (newline - part->words);
+        size_t length = stop - offset;
+        if (length > 0 && part->words[stop - 1] == '\r')
+        {
+            length--;
+        }
+
+        if (length > 0)
+        {
+            entry candidate = {score_bytes(part->words + offset, length), offset, length};
+            push_top(part->top, &part->count, part->k, candidate);
+        }
+        offset = stop + 1;
+    }
+    return NULL;
+}
+
+// Keeps the k best entries as a min-heap, so the weakest is at top[0] and is the only one
+// a new candidate has to beat
+void push_top(entry *top, int *count, int k, entry candidate)
+{
+    int i;
+    if (*count < k)
+    {
+        i = (*count)++;
+        while (i > 0 && ranks_below(candidate, top[(i - 1) / 2]))
+        {
+            top[i] = top[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        top[i] = candidate;
+        return;
+    }
+
+    if (!ranks_below(top[0], candidate))
+    {
+        return;
+    }
+    i = 0;
+    while (true)
+    {
+        int child = 2 * i + 1;
+        if (child >= k)
+        {
+            break;
+        }
+        if (child + 1 < k && ranks_below(top[child + 1], top[child]))
+        {
+            child++;
+        }
+        if (!ranks_below(top[child], candidate))
+        {
+            break;
+        }
+        top[i] = top[child];
+        i = child;
+    }
+    top[i] = candidate;
+}
+
+bool ranks_below(entry a, entry b)
+{
+    return a.score < b.score || (a.score == b.score && a.offset > b.offset);
+}
+
+int compare_entries(const void *a, const void *b)
+{
+    entry x = *(const entry *) a;
+    entry y = *(const entry *) b;
+    return ranks_below(x, y) ? 1 : ranks_below(y, x) ? -1 : 0;
+}
+
+static int score_scalar(const char *word, size_t length)
+{
+    int score = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        score += POINTS[(unsigned char) word[i]];
     }
     return score;
 }
+
+#if defined(__x86_64__)
+// Folds case with 0x20, turns 'a'..'z' into indexes 0..25 and looks the points up with two
+// 16-entry byte shuffles, one for 'a'..'p' and one for 'q'..'z'
+__attribute__((target("avx2")))
+static int score_avx2(const char *word, size_t length)
+{
+    unsigned char low[16];
+    unsigned char high[16] = {0};
+    for (int i = 0; i < 16; i++)
+    {
+        low[i] = POINTS['a' + i];
+    }
+    for (int i = 0; i < 10; i++)
+    {
+        high[i] = POINTS['q' + i];
+    }
+
+    const __m256i low_points = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) low));
+    const __m256i high_points = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) high));
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i before_a = _mm256_set1_epi8('a' - 1);
+    const __m256i after_z = _mm256_set1_epi8('z' + 1);
+    const __m256i a = _mm256_set1_epi8('a');
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i fifteen = _mm256_set1_epi8(15);
+    __m256i sums = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *) (word + i));
+        __m256i folded = _mm256_or_si256(chunk, case_bit);
+        __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(folded, before_a), _mm256_cmpgt_epi8(after_z, folded));
+        __m256i index = _mm256_sub_epi8(folded, a);
+        __m256i column = _mm256_and_si256(index, nibble);
+        __m256i points = _mm256_blendv_epi8(_mm256_shuffle_epi8(low_points, column),
+                                            _mm256_shuffle_epi8(high_points, column),
+                                            _mm256_cmpgt_epi8(index, fifteen));
+        sums = _mm256_add_epi64(sums, _mm256_sad_epu8(_mm256_and_si256(points, letters), _mm256_setzero_si256()));
+    }
+
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    long score = _mm_cvtsi128_si64(half) + _mm_extract_epi64(half, 1);
+    return score + score_scalar(word + i, length - i);
+}
+#endif
+
+// Uses the AVX2 kernel for long words when the CPU has it
+score_kernel select_kernel(void)
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return score_avx2;
+    }
+#endif
+    return score_scalar;
+}
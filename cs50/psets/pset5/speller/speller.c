@@ -0,0 +1,1068 @@
+#define _DEFAULT_SOURCE
+
+#include <cs50.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+// Longest word a dictionary or a text can hold (pneumonoultramicroscopicsilicovolcanoconiosis)
+#define LENGTH 45
+
+// Dictionary used when only a text is given
+#define DICTIONARY "dictionaries/large"
+
+// Smallest part of a text given a thread of its own, and most threads a text is checked on
+#define PART_SIZE 65536
+#define MAX_THREADS 256
+
+// Smallest table, in slots
+#define MIN_SLOTS 16
+
+// First bytes of a compiled dictionary, a hash table or a perfect one; the last digit is the
+// format version, which changes whenever the layout or hash_word does
+#define MAGIC 0x3130524C4C455053
+#define PERFECT_MAGIC 0x3130504C4C455053
+
+// Average words per bucket of a perfect table, and one spare position per SLACK words so the
+// last buckets still find free positions quickly
+#define BUCKET_SIZE 5
+#define SLACK 64
+
+// Seeds tried before giving up on a perfect table
+#define SEEDS 64
+
+// Bits in a block of the Bloom filter, one cache line
+#define BLOCK_BITS 512
+#define BLOCK_SHIFT 9
+
+// One dictionary word: its full hash, so most mismatches never reach the key, and where its
+// lowercased key starts in the arena. Four slots share a cache line
+typedef struct
+{
+    uint64_t hash;
+    uint32_t offset;
+    uint32_t length;
+}
+slot;
+
+// One word of a perfect table: the low half of its hash, checked before the key is, and where the
+// key starts in the arena
+typedef struct
+{
+    uint32_t fingerprint;
+    uint32_t offset;
+}
+entry;
+
+// A minimal perfect hash: a word's bucket holds a pilot, and hashing the word with that pilot
+// gives a position no other word has. Positions past the last entry are remapped into the holes
+// below it, so there is exactly one entry per word and one probe per lookup
+typedef struct
+{
+    entry *entries;
+    uint16_t *pilots;
+    uint32_t *remap;
+    uint64_t buckets;
+    uint64_t positions;
+    uint64_t seed;
+}
+perfect;
+
+// A Bloom filter in front of the table, sized for the dictionary when it is loaded. All the bits
+// a word sets fall in one block, so a word costs one cache line however many probes it makes
+typedef struct
+{
+    uint64_t (*blocks)[BLOCK_BITS / 64];
+    uint64_t count;
+    int probes;
+}
+bloom;
+
+// Open addressing with linear probing, at most half full. A slot whose hash is 0 is empty; stored
+// hashes always have their lowest bit set. Keys sit back to back in one arena, each followed by
+// a NUL. A compiled dictionary is used where it is mapped, and may be a perfect table instead,
+// in which case there are no slots. Either kind can have a filter, which is never compiled
+typedef struct
+{
+    slot *slots;
+    uint64_t mask;
+    int shift;
+    char *keys;
+    size_t used;
+    unsigned int words;
+    perfect minimal;
+    bloom filter;
+    void *base;
+    size_t mapped;
+}
+table;
+
+// Start of a compiled dictionary, padded to a cache line so the slots right after it stay
+// aligned. The arena follows the slots, and since slots refer to keys by offset the file can be
+// mapped at any address. A perfect table has its entries, pilots and remap in place of the slots,
+// and slots counts its positions
+typedef struct
+{
+    uint64_t magic;
+    uint64_t slots;
+    uint64_t used;
+    uint64_t words;
+    uint64_t buckets;
+    uint64_t seed;
+    char padding[16];
+}
+header;
+
+// What checking a text found: the counts, and the misspellings one per line in the order they
+// were found. lost is set if a misspelling could not be kept
+typedef struct
+{
+    unsigned int words;
+    unsigned int misspellings;
+    char *misspelled;
+    size_t used;
+    size_t capacity;
+    bool lost;
+}
+tally;
+
+// A slice of a text checked by one thread, starting and ending between words
+typedef struct
+{
+    const char *text;
+    size_t length;
+    tally counts;
+}
+part;
+
+void print_usage(void);
+bool load(const char *dictionary);
+bool build_table(const char *text, size_t length);
+bool map_table(const void *base, size_t length);
+bool map_perfect(const void *base, size_t length);
+bool compile(const char *path, bool minimal);
+bool build_perfect(perfect *minimal);
+bool write_parts(const char *path, const void *parts[], const size_t sizes[], int count);
+bool build_filter(double rate);
+double blocked_rate(uint64_t count, int probes);
+void mark_word(uint64_t hash);
+bool might_contain(uint64_t hash);
+bool check(const char *word);
+bool lookup(const char *word, int length);
+unsigned int size(void);
+bool unload(void);
+uint64_t hash_word(const char *word, int length, char *lower);
+slot *find_slot(uint64_t hash, const char *lower, int length);
+bool find_entry(uint64_t hash, const char *lower, int length);
+uint64_t bucket_of(uint64_t hash, uint64_t buckets);
+uint64_t place(uint64_t hash, uint64_t seed, uint64_t pilot, uint64_t positions);
+int check_file(string path, int threads, tally *counts);
+size_t word_boundary(const char *text, size_t length, size_t position);
+void *check_part(void *arg);
+void check_text(const char *text, size_t length, tally *counts);
+void check_word(const char *word, int length, tally *counts);
+double calculate(const struct rusage *before, const struct rusage *after);
+
+table dictionary;
+
+int main(int argc, string argv[])
+{
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    string output = NULL;
+    bool minimal = false;
+    double rate = 0;
+    int option;
+    while ((option = getopt(argc, argv, "j:c:pf:")) != -1)
+    {
+        if (option == 'j' && (threads = atoi(optarg)) >= 1)
+        {
+            continue;
+        }
+        else if (option == 'c')
+        {
+            output = optarg;
+        }
+        else if (option == 'p')
+        {
+            minimal = true;
+        }
+        else if (option == 'f' && (rate = atof(optarg)) > 0 && rate < 1)
+        {
+            continue;
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+    int arguments = argc - optind;
+    if (output != NULL ? arguments != 1 || rate > 0 : minimal || (arguments != 1 && arguments != 2))
+    {
+        print_usage();
+        return 1;
+    }
+
+    // -c turns a dictionary into one that later runs map instead of build, -p into a perfect one
+    if (output != NULL)
+    {
+        if (!load(argv[optind]))
+        {
+            printf("Could not load %s.\n", argv[optind]);
+            return 1;
+        }
+        if (dictionary.slots == NULL)
+        {
+            printf("%s is already a perfect dictionary.\n", argv[optind]);
+            unload();
+            return 1;
+        }
+        bool written = compile(output, minimal);
+        unload();
+        if (!written)
+        {
+            printf("Could not write %s.\n", output);
+            return 1;
+        }
+        return 0;
+    }
+
+    struct rusage before, after;
+    double time_load, time_check, time_size, time_unload;
+
+    string path = arguments == 2 ? argv[optind] : DICTIONARY;
+    getrusage(RUSAGE_SELF, &before);
+    bool loaded = load(path);
+    if (loaded && rate > 0 && !build_filter(rate))
+    {
+        unload();
+        loaded = false;
+    }
+    getrusage(RUSAGE_SELF, &after);
+    if (!loaded)
+    {
+        printf("Could not load %s.\n", path);
+        return 1;
+    }
+    time_load = calculate(&before, &after);
+
+    printf("\nMISSPELLED WORDS\n\n");
+    tally counts = {0};
+    getrusage(RUSAGE_SELF, &before);
+    int status = check_file(argv[argc - 1], threads, &counts);
+    getrusage(RUSAGE_SELF, &after);
+    if (status != 0)
+    {
+        unload();
+        return status;
+    }
+    time_check = calculate(&before, &after);
+
+    getrusage(RUSAGE_SELF, &before);
+    unsigned int n = size();
+    getrusage(RUSAGE_SELF, &after);
+    time_size = calculate(&before, &after);
+
+    getrusage(RUSAGE_SELF, &before);
+    bool unloaded = unload();
+    getrusage(RUSAGE_SELF, &after);
+    if (!unloaded)
+    {
+        printf("Could not unload %s.\n", path);
+        return 1;
+    }
+    time_unload = calculate(&before, &after);
+
+    printf("\nWORDS MISSPELLED:     %u\n", counts.misspellings);
+    printf("WORDS IN DICTIONARY:  %u\n", n);
+    printf("WORDS IN TEXT:        %u\n", counts.words);
+    printf("TIME IN load:         %.2f\n", time_load);
+    printf("TIME IN check:        %.2f\n", time_check);
+    printf("TIME IN size:         %.2f\n", time_size);
+    printf("TIME IN unload:       %.2f\n", time_unload);
+    printf("TIME IN TOTAL:        %.2f\n\n", time_load + time_check + time_size + time_unload);
+    return 0;
+}
+
+void print_usage(void)
+{
+    printf("Usage: ./speller [-j threads] [-f rate] [DICTIONARY] text\n");
+    printf("       ./speller -c compiled [-p] DICTIONARY\n");
+}
+
+// Maps the dictionary and either uses it as it is, if it was compiled, or builds a table from it
+bool load(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        return false;
+    }
+
+    size_t length = info.st_size;
+    const char *text = length > 0 ? mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0) : "";
+    close(fd);
+    if (text == MAP_FAILED)
+    {
+        return false;
+    }
+
+    uint64_t magic = length >= sizeof(header) ? ((const header *) text)->magic : 0;
+    if (magic == MAGIC || magic == PERFECT_MAGIC)
+    {
+        if (magic == MAGIC ? map_table(text, length) : map_perfect(text, length))
+        {
+            return true;
+        }
+        munmap((void *) text, length);
+        return false;
+    }
+
+    bool built = build_table(text, length);
+    if (length > 0)
+    {
+        munmap((void *) text, length);
+    }
+    return built;
+}
+
+// Builds the table from a file of one word per line. The line count bounds the number of words
+// and the file size bounds the arena, so both are allocated once, before any word is inserted
+bool build_table(const char *text, size_t length)
+{
+    size_t lines = 1;
+    for (const char *p = text; (p = memchr(p, '\n', text + length - p)) != NULL; p++)
+    {
+        lines++;
+    }
+
+    size_t slots = MIN_SLOTS;
+    int bits = __builtin_ctzll(MIN_SLOTS);
+    while (slots < 2 * lines)
+    {
+        slots *= 2;
+        bits++;
+    }
+    dictionary = (table) {.slots = calloc(slots, sizeof(slot)), .mask = slots - 1, .shift = 64 - bits,
+                          .keys = malloc(length + 1)};
+
+    const char *cursor = text;
+    const char *end = text + length;
+    while (dictionary.slots != NULL && dictionary.keys != NULL && cursor < end)
+    {
+        const char *newline = memchr(cursor, '\n', end - cursor);
+        const char *stop = newline == NULL ? end : newline;
+        int letters = stop - cursor;
+        if (letters > 0 && stop[-1] == '\r')
+        {
+            letters--;
+        }
+
+        // Lowercase straight into the arena; the key is only kept if it is new
+        if (letters > 0 && letters <= LENGTH)
+        {
+            char *key = dictionary.keys + dictionary.used;
+            uint64_t hash = hash_word(cursor, letters, key);
+            slot *home = find_slot(hash, key, letters);
+            if (home != NULL && home->hash == 0)
+            {
+                *home = (slot) {hash, dictionary.used, letters};
+                key[letters] = '\0';
+                dictionary.used += letters + 1;
+                dictionary.words++;
+            }
+        }
+        cursor = stop + 1;
+    }
+
+    if (dictionary.slots == NULL || dictionary.keys == NULL)
+    {
+        unload();
+        return false;
+    }
+    return true;
+}
+
+// Points the table into a compiled dictionary, after checking that its parts fit the file. Only
+// the header is read here, so loading stays instant; the slots are not trusted either, but
+// find_slot checks each one it compares against, which costs nothing on the slots never probed
+bool map_table(const void *base, size_t length)
+{
+    const header *head = base;
+    size_t slots = head->slots;
+    if (slots < MIN_SLOTS || (slots & (slots - 1)) != 0 || head->words > slots / 2 ||
+        slots > (length - sizeof(header)) / sizeof(slot) ||
+        head->used != length - sizeof(header) - slots * sizeof(slot))
+    {
+        return false;
+    }
+
+    slot *first = (slot *) (head + 1);
+    const char *keys = (const char *) (first + slots);
+    dictionary = (table) {.slots = first, .mask = slots - 1, .shift = 64 - __builtin_ctzll(slots),
+                          .keys = (char *) keys, .used = head->used, .words = head->words,
+                          .base = (void *) base, .mapped = length};
+    return true;
+}
+
+// Points the perfect table into a compiled dictionary, after checking that its parts fit the file
+// and that nothing in them points outside it. The pilots are padded to a whole number of pairs so
+// the remap after them stays aligned
+bool map_perfect(const void *base, size_t length)
+{
+    const header *head = base;
+    uint64_t words = head->words;
+    uint64_t buckets = head->buckets;
+    uint64_t positions = head->slots;
+    if (words > length || buckets == 0 || buckets > length || positions <= words || positions - words > length ||
+        head->used > length || words * sizeof(entry) + (buckets + buckets % 2) * sizeof(uint16_t) +
+        (positions - words) * sizeof(uint32_t) + head->used != length - sizeof(header))
+    {
+        return false;
+    }
+
+    // Every remapped position must be an entry and every key must start in the arena; since the
+    // arena ends in a NUL, no key comparison can then run past it
+    entry *entries = (entry *) (head + 1);
+    uint16_t *pilots = (uint16_t *) (entries + words);
+    uint32_t *remap = (uint32_t *) (pilots + buckets + buckets % 2);
+    const char *keys = (const char *) (remap + positions - words);
+    if (words > 0 && (head->used == 0 || keys[head->used - 1] != '\0'))
+    {
+        return false;
+    }
+    for (uint64_t i = 0; i < positions - words; i++)
+    {
+        if (words > 0 && remap[i] >= words)
+        {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < words; i++)
+    {
+        if (entries[i].offset >= head->used)
+        {
+            return false;
+        }
+    }
+
+    dictionary = (table) {.keys = (char *) keys, .used = head->used, .words = words,
+                          .minimal = {entries, pilots, remap, buckets, positions, head->seed},
+                          .base = (void *) base, .mapped = length};
+    return true;
+}
+
+// Writes the table as a compiled dictionary, or the perfect table built from it
+bool compile(const char *path, bool minimal)
+{
+    size_t slots = dictionary.mask + 1;
+    header head = {MAGIC, slots, dictionary.used, dictionary.words, 0, 0, {0}};
+    if (!minimal)
+    {
+        const void *parts[] = {&head, dictionary.slots, dictionary.keys};
+        const size_t sizes[] = {sizeof(header), slots * sizeof(slot), dictionary.used};
+        return write_parts(path, parts, sizes, 3);
+    }
+
+    perfect built;
+    if (!build_perfect(&built))
+    {
+        return false;
+    }
+    uint64_t words = dictionary.words;
+    head = (header) {PERFECT_MAGIC, built.positions, dictionary.used, words, built.buckets, built.seed, {0}};
+    const void *parts[] = {&head, built.entries, built.pilots, built.remap, dictionary.keys};
+    const size_t sizes[] =
+    {
+        sizeof(header), words * sizeof(entry), (built.buckets + built.buckets % 2) * sizeof(uint16_t),
+        (built.positions - words) * sizeof(uint32_t), dictionary.used
+    };
+    bool written = write_parts(path, parts, sizes, 5);
+    free(built.entries);
+    free(built.pilots);
+    free(built.remap);
+    return written;
+}
+
+// Gives every bucket a pilot, largest buckets first while most positions are still free. A seed
+// under which some bucket finds no pilot is abandoned for the next one
+bool build_perfect(perfect *minimal)
+{
+    uint64_t words = dictionary.words;
+    uint64_t buckets = words / BUCKET_SIZE + 1;
+    uint64_t positions = words + words / SLACK + 1;
+    *minimal = (perfect) {malloc((words + 1) * sizeof(entry)), calloc(buckets + 1, sizeof(uint16_t)),
+                          malloc((positions - words) * sizeof(uint32_t)), buckets, positions, 0};
+
+    // The words' hashes and keys grouped by bucket, and the buckets from largest to smallest
+    uint64_t *hashes = malloc((words + 1) * sizeof(uint64_t));
+    uint32_t *offsets = malloc((words + 1) * sizeof(uint32_t));
+    uint64_t *spots = malloc((words + 1) * sizeof(uint64_t));
+    uint32_t *starts = calloc(buckets + 1, sizeof(uint32_t));
+    uint32_t *order = malloc(buckets * sizeof(uint32_t));
+    uint8_t *taken = malloc(positions);
+    bool placed = false;
+    if (minimal->entries != NULL && minimal->pilots != NULL && minimal->remap != NULL && hashes != NULL &&
+        offsets != NULL && spots != NULL && starts != NULL && order != NULL && taken != NULL)
+    {
+        uint32_t largest = 0;
+        for (uint64_t i = 0; i <= dictionary.mask; i++)
+        {
+            if (dictionary.slots[i].hash != 0)
+            {
+                starts[bucket_of(dictionary.slots[i].hash, buckets) + 1]++;
+            }
+        }
+        for (uint64_t b = 0; b < buckets; b++)
+        {
+            largest = starts[b + 1] > largest ? starts[b + 1] : largest;
+            starts[b + 1] += starts[b];
+        }
+        for (uint64_t i = 0; i <= dictionary.mask; i++)
+        {
+            const slot *word = &dictionary.slots[i];
+            if (word->hash != 0)
+            {
+                uint32_t k = --starts[bucket_of(word->hash, buckets) + 1];
+                hashes[k] = word->hash;
+                offsets[k] = word->offset;
+            }
+        }
+        // Filling counted each bucket's end down to its start, which now sits one place too far
+        for (uint64_t b = 0; b < buckets; b++)
+        {
+            starts[b] = starts[b + 1];
+        }
+        starts[buckets] = words;
+
+        uint64_t count = 0;
+        for (uint32_t size = largest; size > 0; size--)
+        {
+            for (uint64_t b = 0; b < buckets; b++)
+            {
+                if (starts[b + 1] - starts[b] == size)
+                {
+                    order[count++] = b;
+                }
+            }
+        }
+
+        for (uint64_t seed = 0; seed < SEEDS && !placed; seed++)
+        {
+            memset(taken, 0, positions);
+            placed = true;
+            for (uint64_t i = 0; i < count && placed; i++)
+            {
+                uint32_t first = starts[order[i]];
+                uint32_t last = starts[order[i] + 1];
+                placed = false;
+                for (uint64_t pilot = 0; pilot <= UINT16_MAX && !placed; pilot++)
+                {
+                    uint32_t k = first;
+                    while (k < last && !taken[spots[k] = place(hashes[k], seed, pilot, positions)])
+                    {
+                        taken[spots[k++]] = 1;
+                    }
+                    if (k == last)
+                    {
+                        minimal->pilots[order[i]] = pilot;
+                        placed = true;
+                    }
+                    while (!placed && k > first)
+                    {
+                        taken[spots[--k]] = 0;
+                    }
+                }
+            }
+            minimal->seed = seed;
+        }
+    }
+
+    if (placed)
+    {
+        // As many positions past the last entry are taken as below it are free
+        uint64_t hole = 0;
+        for (uint64_t p = words; p < positions; p++)
+        {
+            minimal->remap[p - words] = 0;
+            if (taken[p])
+            {
+                while (taken[hole])
+                {
+                    hole++;
+                }
+                minimal->remap[p - words] = hole++;
+            }
+        }
+        for (uint64_t k = 0; k < words; k++)
+        {
+            uint64_t p = spots[k] < words ? spots[k] : minimal->remap[spots[k] - words];
+            minimal->entries[p] = (entry) {hashes[k], offsets[k]};
+        }
+    }
+    else
+    {
+        free(minimal->entries);
+        free(minimal->pilots);
+        free(minimal->remap);
+    }
+    free(hashes);
+    free(offsets);
+    free(spots);
+    free(starts);
+    free(order);
+    free(taken);
+    return placed;
+}
+
+// Writes the parts of a compiled dictionary one after another. The file is written beside the
+// target and renamed over it, so runs that still map the old file are unaffected
+bool write_parts(const char *path, const void *parts[], const size_t sizes[], int count)
+{
+    char temporary[strlen(path) + 5];
+    sprintf(temporary, "%s.tmp", path);
+    FILE *file = fopen(temporary, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    bool written = true;
+    for (int i = 0; i < count && written; i++)
+    {
+        written = fwrite(parts[i], 1, sizes[i], file) == sizes[i];
+    }
+    if (fclose(file) != 0 || !written || rename(temporary, path) != 0)
+    {
+        remove(temporary);
+        return false;
+    }
+    return true;
+}
+
+// Sizes the filter for the loaded words and the false positive rate asked for, then adds every
+// word. The size an unblocked filter would need is only a start: blocks fill unevenly, so it
+// grows until blocks would do
+bool build_filter(double rate)
+{
+    double bits = -log(rate) / (log(2) * log(2)) * dictionary.words;
+    int probes = round(-log2(rate));
+    probes = probes < 1 ? 1 : probes > 16 ? 16 : probes;
+    uint64_t count = ceil(bits / BLOCK_BITS);
+    count = count > 0 ? count : 1;
+    while (blocked_rate(count, probes) > rate)
+    {
+        count += count / 16 + 1;
+    }
+    dictionary.filter = (bloom) {aligned_alloc(64, count * (BLOCK_BITS / 8)), count, probes};
+    if (dictionary.filter.blocks == NULL)
+    {
+        return false;
+    }
+    memset(dictionary.filter.blocks, 0, count * (BLOCK_BITS / 8));
+
+    // Slots keep their full hashes. A perfect entry keeps only half of one, so its key is hashed
+    // again; a compiled key longer than any word could only come from a corrupt file
+    if (dictionary.slots != NULL)
+    {
+        for (uint64_t i = 0; i <= dictionary.mask; i++)
+        {
+            if (dictionary.slots[i].hash != 0)
+            {
+                mark_word(dictionary.slots[i].hash);
+            }
+        }
+        return true;
+    }
+    char lower[LENGTH + 1];
+    for (uint64_t i = 0; i < dictionary.words; i++)
+    {
+        const char *key = dictionary.keys + dictionary.minimal.entries[i].offset;
+        size_t length = strnlen(key, LENGTH + 1);
+        if (length > LENGTH)
+        {
+            return false;
+        }
+        mark_word(hash_word(key, length, lower));
+    }
+    return true;
+}
+
+// Expected false positive rate of a blocked filter: the words per block are Poisson distributed,
+// and a block holding i words answers like a small unblocked filter of i words
+double blocked_rate(uint64_t count, int probes)
+{
+    double mean = (double) dictionary.words / count;
+    double chance = exp(-mean);
+    double rate = 0;
+    for (int i = 0; i < mean + 10 * sqrt(mean) + 10; i++)
+    {
+        rate += chance * pow(1 - pow(1 - 1.0 / BLOCK_BITS, (double) probes * i), probes);
+        chance *= mean / (i + 1);
+    }
+    return rate;
+}
+
+// The block comes from the high half of the hash; each bit within it is the top of the hash
+// multiplied once more
+void mark_word(uint64_t hash)
+{
+    const bloom *filter = &dictionary.filter;
+    uint64_t *block = filter->blocks[((hash >> 32) * filter->count) >> 32];
+    uint64_t mixed = hash;
+    for (int i = 0; i < filter->probes; i++)
+    {
+        mixed *= 0x9E3779B97F4A7C15;
+        uint64_t bit = mixed >> (64 - BLOCK_SHIFT);
+        block[bit / 64] |= (uint64_t) 1 << (bit % 64);
+    }
+}
+
+// False means the word is certainly not in the dictionary
+bool might_contain(uint64_t hash)
+{
+    const bloom *filter = &dictionary.filter;
+    const uint64_t *block = filter->blocks[((hash >> 32) * filter->count) >> 32];
+    uint64_t mixed = hash;
+    for (int i = 0; i < filter->probes; i++)
+    {
+        mixed *= 0x9E3779B97F4A7C15;
+        uint64_t bit = mixed >> (64 - BLOCK_SHIFT);
+        if ((block[bit / 64] & (uint64_t) 1 << (bit % 64)) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool check(const char *word)
+{
+    size_t length = strlen(word);
+    return length <= LENGTH && lookup(word, length);
+}
+
+// Hashes the word once; the filter, if any, settles most misses before the table is touched
+bool lookup(const char *word, int length)
+{
+    char lower[LENGTH + 1];
+    uint64_t hash = hash_word(word, length, lower);
+    if (dictionary.filter.blocks != NULL && !might_contain(hash))
+    {
+        return false;
+    }
+    if (dictionary.slots == NULL)
+    {
+        return find_entry(hash, lower, length);
+    }
+    slot *found = find_slot(hash, lower, length);
+    return found != NULL && found->hash != 0;
+}
+
+unsigned int size(void)
+{
+    return dictionary.words;
+}
+
+bool unload(void)
+{
+    free(dictionary.filter.blocks);
+    if (dictionary.mapped > 0)
+    {
+        munmap(dictionary.base, dictionary.mapped);
+    }
+    else
+    {
+        free(dictionary.slots);
+        free(dictionary.keys);
+    }
+    dictionary = (table) {NULL};
+    return true;
+}
+
+// FNV-1a over the lowercased word, which is written to lower as it goes, then a murmur3
+// finalizer so the high bits used for the home slot depend on every byte
+uint64_t hash_word(const char *word, int length, char *lower)
+{
+    uint64_t hash = 0xCBF29CE484222325;
+    for (int i = 0; i < length; i++)
+    {
+        char c = word[i];
+        c = c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+        lower[i] = c;
+        hash = (hash ^ (unsigned char) c) * 0x100000001B3;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCD;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53;
+    hash ^= hash >> 33;
+    return hash | 1;
+}
+
+// Returns the slot holding the key, or the empty slot where it would go. A table is never full,
+// but a probe still stops after visiting every slot, returning NULL. A compiled table may be
+// corrupt, so a key is only compared if it lies in the arena; words are never longer than
+// LENGTH, so neither is any key that matches one
+slot *find_slot(uint64_t hash, const char *lower, int length)
+{
+    uint64_t i = hash >> dictionary.shift;
+    for (uint64_t probes = 0; probes <= dictionary.mask; probes++, i = (i + 1) & dictionary.mask)
+    {
+        slot *candidate = &dictionary.slots[i];
+        if (candidate->hash == 0 || (candidate->hash == hash && candidate->length == (uint32_t) length &&
+                                     (uint64_t) candidate->offset + length < dictionary.used &&
+                                     memcmp(dictionary.keys + candidate->offset, lower, length) == 0))
+        {
+            return candidate;
+        }
+    }
+    return NULL;
+}
+
+// The only entry a word can be at in a perfect table; words never added land on some other
+// word's entry, which the fingerprint and then the key reject
+bool find_entry(uint64_t hash, const char *lower, int length)
+{
+    const perfect *minimal = &dictionary.minimal;
+    if (dictionary.words == 0)
+    {
+        return false;
+    }
+
+    uint64_t pilot = minimal->pilots[bucket_of(hash, minimal->buckets)];
+    uint64_t position = place(hash, minimal->seed, pilot, minimal->positions);
+    if (position >= dictionary.words)
+    {
+        position = minimal->remap[position - dictionary.words];
+    }
+    const entry *word = &minimal->entries[position];
+    const char *key = dictionary.keys + word->offset;
+    return word->fingerprint == (uint32_t) hash && strncmp(key, lower, length) == 0 && key[length] == '\0';
+}
+
+// Buckets come from the high half of the hash, the fingerprint from the low half
+uint64_t bucket_of(uint64_t hash, uint64_t buckets)
+{
+    return ((hash >> 32) * buckets) >> 32;
+}
+
+// Where a pilot sends a word: the hash mixed with the seed and pilot, scaled to the positions
+uint64_t place(uint64_t hash, uint64_t seed, uint64_t pilot, uint64_t positions)
+{
+    uint64_t mixed = hash ^ ((seed << 16 | pilot) * 0x9E3779B97F4A7C15);
+    mixed ^= mixed >> 33;
+    mixed *= 0xFF51AFD7ED558CCD;
+    mixed ^= mixed >> 33;
+    return ((unsigned __int128) mixed * positions) >> 64;
+}
+
+// Maps the text and checks it in parts, one per thread. Every part keeps its own misspellings,
+// which are printed part by part once all are done, so the output is that of a single pass
+int check_file(string path, int threads, tally *counts)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        printf("Could not open %s.\n", path);
+        return 1;
+    }
+
+    size_t length = info.st_size;
+    const char *text = length > 0 ? mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0) : "";
+    close(fd);
+    if (text == MAP_FAILED)
+    {
+        printf("Could not map %s.\n", path);
+        return 1;
+    }
+    if (length > 0)
+    {
+        madvise((void *) text, length, MADV_SEQUENTIAL);
+    }
+
+    if ((size_t) threads > length / PART_SIZE + 1)
+    {
+        threads = length / PART_SIZE + 1;
+    }
+    threads = threads < MAX_THREADS ? threads : MAX_THREADS;
+    part *parts = malloc(threads * sizeof(part));
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    if (parts == NULL || workers == NULL)
+    {
+        free(parts);
+        free(workers);
+        if (length > 0)
+        {
+            munmap((void *) text, length);
+        }
+        printf("Not enough memory to check %s.\n", path);
+        return 1;
+    }
+    size_t start = 0;
+    for (int i = 0; i < threads; i++)
+    {
+        size_t end = length * (i + 1) / threads;
+        end = word_boundary(text, length, end > start ? end : start);
+        parts[i] = (part) {text + start, end - start, {0}};
+        start = end;
+    }
+
+    // Parts that could not get a thread of their own are checked on this one
+    int started = 0;
+    while (started < threads && pthread_create(&workers[started], NULL, check_part, &parts[started]) == 0)
+    {
+        started++;
+    }
+    for (int i = started; i < threads; i++)
+    {
+        check_part(&parts[i]);
+    }
+
+    for (int i = 0; i < threads; i++)
+    {
+        if (i < started)
+        {
+            pthread_join(workers[i], NULL);
+        }
+        counts->lost = counts->lost || parts[i].counts.lost;
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        if (!counts->lost)
+        {
+            fwrite(parts[i].counts.misspelled, 1, parts[i].counts.used, stdout);
+            counts->words += parts[i].counts.words;
+            counts->misspellings += parts[i].counts.misspellings;
+        }
+        free(parts[i].counts.misspelled);
+    }
+    free(parts);
+    free(workers);
+
+    if (length > 0)
+    {
+        munmap((void *) text, length);
+    }
+    if (counts->lost)
+    {
+        printf("Not enough memory to check %s.\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+// Moves a split point forward until the character before it is neither a letter, a digit nor an
+// apostrophe. Whatever check_text was doing, such a character leaves it between words, so a
+// part starting there is scanned exactly as the whole text would be
+size_t word_boundary(const char *text, size_t length, size_t position)
+{
+    while (position > 0 && position < length &&
+           (isalnum((unsigned char) text[position - 1]) || text[position - 1] == '\''))
+    {
+        position++;
+    }
+    return position;
+}
+
+void *check_part(void *arg)
+{
+    part *slice = arg;
+    check_text(slice->text, slice->length, &slice->counts);
+    return NULL;
+}
+
+// Words are letters and apostrophes, not starting with an apostrophe. Words with digits and
+// words longer than LENGTH are skipped, together with the character that ends them. Every word
+// is contiguous in the text, so it is looked up where it lies
+void check_text(const char *text, size_t length, tally *counts)
+{
+    size_t start = 0;
+    int index = 0;
+    size_t i = 0;
+    while (i < length)
+    {
+        unsigned char c = text[i++];
+        if (isalpha(c) || (c == '\'' && index > 0))
+        {
+            if (index++ == 0)
+            {
+                start = i - 1;
+            }
+            if (index > LENGTH)
+            {
+                while (i < length && isalpha((unsigned char) text[i++]));
+                index = 0;
+            }
+        }
+        else if (isdigit(c))
+        {
+            while (i < length && isalnum((unsigned char) text[i++]));
+            index = 0;
+        }
+        else if (index > 0)
+        {
+            check_word(text + start, index, counts);
+            index = 0;
+        }
+    }
+
+    // A text may end in the middle of a word
+    if (index > 0)
+    {
+        check_word(text + start, index, counts);
+    }
+}
+
+// Counts the word and keeps it if it is misspelled, growing the list by doubling
+void check_word(const char *word, int length, tally *counts)
+{
+    counts->words++;
+    if (lookup(word, length))
+    {
+        return;
+    }
+
+    counts->misspellings++;
+    if (counts->used + length + 1 > counts->capacity)
+    {
+        size_t capacity = counts->capacity < PART_SIZE ? PART_SIZE : 2 * counts->capacity;
+        char *larger = realloc(counts->misspelled, capacity);
+        if (larger == NULL)
+        {
+            counts->lost = true;
+            return;
+        }
+        counts->misspelled = larger;
+        counts->capacity = capacity;
+    }
+    memcpy(counts->misspelled + counts->used, word, length);
+    counts->misspelled[counts->used + length] = '\n';
+    counts->used += length + 1;
+}
+
+// Returns number of seconds between b and a
+double calculate(const struct rusage *b, const struct rusage *a)
+{
+    if (b == NULL || a == NULL)
+    {
+        return 0.0;
+    }
+    return ((((a->ru_utime.tv_sec * 1000000 + a->ru_utime.tv_usec) -
+              (b->ru_utime.tv_sec * 1000000 + b->ru_utime.tv_usec)) +
+             ((a->ru_stime.tv_sec * 1000000 + a->ru_stime.tv_usec) -
+              (b->ru_stime.tv_sec * 1000000 + b->ru_stime.tv_usec)))
+            / 1000000.0);
+}
@@ -3,7 +3,10 @@
 
 int main(int argc, string argv[]){
 
-    
+    if (argc != 3)
+    {
+        printf("Usage: ./greet first last\n");
+        return 1;
+    }
     printf("hello, %s %s\n", argv[1], argv[2]);
 }
-
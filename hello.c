@@ -1,8 +1,92 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <cs50.h>
+#include "input.h"
+
+#define OUTPUT_SIZE (1 << 20)
+
+// Greetings waiting to be written
+typedef struct
+{
+    char data[OUTPUT_SIZE];
+    size_t used;
+}
+output;
+
+int greet_all(FILE *names);
+void append(output *out, const char *text, size_t length);
+void flush(output *out);
+
+int main(int argc, string argv[])
+{
+    // Greet every name in a file, one per line
+    if (argc == 2)
+    {
+        FILE *names = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "r");
+        if (names == NULL)
+        {
+            printf("Could not open %s.\n", argv[1]);
+            return 1;
+        }
+        int status = greet_all(names);
+        if (names != stdin)
+        {
+            fclose(names);
+        }
+        return status;
+    }
+
+    reader in = {0};
+    string name = read_string(&in, "Whats your name? ");
+    if (name != NULL)
+    {
+        printf("hello, %s\n", name);
+    }
+    reader_free(&in);
+}
+
+// Formats every greeting into one large buffer that is written only when full
+int greet_all(FILE *names)
+{
+    static output out;
+    reader in = {0};
+    string line;
+    while ((line = read_line(&in, names)) != NULL)
+    {
+        size_t length = strlen(line);
+        if (length == 0)
+        {
+            continue;
+        }
+        append(&out, "hello, ", 7);
+        append(&out, line, length);
+        append(&out, "\n", 1);
+    }
+    flush(&out);
+    reader_free(&in);
+    return ferror(names) ? 1 : 0;
+}
+
+void append(output *out, const char *text, size_t length)
+{
+    if (out->used + length > OUTPUT_SIZE)
+    {
+        flush(out);
+        if (length > OUTPUT_SIZE)
+        {
+            fwrite(text, 1, length, stdout);
+            return;
+        }
+    }
+    memcpy(out->data + out->used, text, length);
+    out->used += length;
+}
 
-int main(void)
+void flush(output *out)
 {
-    string name = get_string("Whats your name? ");
-    printf("hello, %s\n", name);
+    fwrite(out->data, 1, out->used, stdout);
+    out->used = 0;
 }
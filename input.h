@@ -0,0 +1,152 @@
+// Line input without a heap allocation per call. get_string allocates every string it returns
+// separately; here lines are read into one reusable buffer, and strings that must outlive the
+// next line are copied into an arena of large blocks that is reset once a record is done, so
+// memory stays flat however many records are read. getline is
+// POSIX, so files that include this define _POSIX_C_SOURCE before any system header
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cs50.h>
+
+#define ARENA_BLOCK 4096
+
+typedef struct arena_block
+{
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    char data[];
+}
+arena_block;
+
+// Blocks are chained newest first, each twice the size of the one before; total is what they add
+// up to, so a reset can replace them with a single block that already fits the next record
+typedef struct
+{
+    arena_block *head;
+    size_t total;
+}
+arena;
+
+typedef struct
+{
+    arena strings;
+    char *line;
+    size_t size;
+}
+reader;
+
+// Hands out characters, not general memory: nothing is aligned beyond a byte
+static inline char *arena_chars(arena *pool, size_t length)
+{
+    arena_block *head = pool->head;
+    if (head == NULL || head->size - head->used < length)
+    {
+        size_t size = head == NULL ? ARENA_BLOCK : 2 * head->size;
+        size = size < length ? length : size;
+        arena_block *block = malloc(sizeof(arena_block) + size);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        *block = (arena_block) {head, size, 0};
+        pool->head = head = block;
+        pool->total += size;
+    }
+
+    char *memory = head->data + head->used;
+    head->used += length;
+    return memory;
+}
+
+static inline void arena_free(arena *pool)
+{
+    while (pool->head != NULL)
+    {
+        arena_block *next = pool->head->next;
+        free(pool->head);
+        pool->head = next;
+    }
+    pool->total = 0;
+}
+
+// Forgets every allocation; only an arena that outgrew its single block touches malloc
+static inline void arena_reset(arena *pool)
+{
+    if (pool->head != NULL && pool->head->next != NULL)
+    {
+        size_t total = pool->total;
+        arena_free(pool);
+        arena_block *block = malloc(sizeof(arena_block) + total);
+        if (block != NULL)
+        {
+            *block = (arena_block) {NULL, total, 0};
+            pool->head = block;
+            pool->total = total;
+        }
+    }
+    else if (pool->head != NULL)
+    {
+        pool->head->used = 0;
+    }
+}
+
+static inline string arena_copy(arena *pool, const char *text, size_t length)
+{
+    string copy = arena_chars(pool, length + 1);
+    if (copy != NULL)
+    {
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+// Reads a line into the reusable buffer, without its line ending. The line stays valid until
+// the next call; returns NULL at end of input
+static inline string read_line(reader *in, FILE *stream)
+{
+    ssize_t length = getline(&in->line, &in->size, stream);
+    if (length < 0)
+    {
+        return NULL;
+    }
+    while (length > 0 && (in->line[length - 1] == '\n' || in->line[length - 1] == '\r'))
+    {
+        length--;
+    }
+    in->line[length] = '\0';
+    return in->line;
+}
+
+// Like get_string, but the string lives in the arena until reader_reset or reader_free
+static inline string read_string(reader *in, const char *format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    vprintf(format, arguments);
+    va_end(arguments);
+
+    string line = read_line(in, stdin);
+    return line == NULL ? NULL : arena_copy(&in->strings, line, strlen(line));
+}
+
+// Call once a record is done with; every string read since the last reset goes
+static inline void reader_reset(reader *in)
+{
+    arena_reset(&in->strings);
+}
+
+static inline void reader_free(reader *in)
+{
+    arena_free(&in->strings);
+    free(in->line);
+    in->line = NULL;
+    in->size = 0;
+}
+
+#endif
@@ -1,22 +1,95 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <stdint.h>
 #include <cs50.h>
+#include "input.h"
+
+typedef struct
+{
+    size_t bytes;
+    size_t characters;
+}
+length;
+
+// Lets a whole aligned word of a string be read at once
+typedef uint64_t __attribute__((may_alias)) word;
 
 void get_length(string input);
+length measure(string input);
 
 int main(void)
 {
-    string input = get_string("Whats your name? ");
-    get_length(input);
+    reader in = {0};
+    string name = read_string(&in, "Whats your name? ");
+    if (name != NULL)
+    {
+        get_length(name);
+    }
+    reader_free(&in);
 
 }
 
 void get_length(string input)
 {
-    int length = 0;
-    do
+    length size = measure(input);
+    if (size.characters == size.bytes)
+    {
+        printf("%s is %zu characters!\n", input, size.characters);
+    }
+    else
     {
-        length++;
+        printf("%s is %zu characters (%zu bytes)!\n", input, size.characters, size.bytes);
     }
-    while (input[length] != 0);
-    printf("%s is %i characters!\n", input, length);
-}
\ No newline at end of file
+}
+
+// Counts bytes and UTF-8 code points together. Every byte that is not a continuation byte
+// (10xxxxxx) starts a code point, so characters = bytes - continuation bytes. After reaching
+// 8-byte alignment the string is read a word at a time; an aligned word never crosses a page,
+// so reading past the NUL within it is safe
+length measure(string input)
+{
+    const unsigned char *p = (const unsigned char *) input;
+    size_t continuation = 0;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while ((uintptr_t) p % sizeof(word) != 0 && *p != '\0')
+    {
+        continuation += (*p & 0xC0) == 0x80;
+        p++;
+    }
+
+    if ((uintptr_t) p % sizeof(word) == 0)
+    {
+        const uint64_t ones = 0x0101010101010101;
+        const uint64_t highs = 0x8080808080808080;
+        while (true)
+        {
+            uint64_t bytes = *(const word *) p;
+
+            // High bit set where a byte is 10xxxxxx, and (exactly, up to the first NUL) where it is 0
+            uint64_t tails = bytes & ~(bytes << 1) & highs;
+            uint64_t zeros = (bytes - ones) & ~bytes & highs;
+            if (zeros != 0)
+            {
+                int before = __builtin_ctzll(zeros) / 8;
+                uint64_t kept = before == 0 ? 0 : UINT64_MAX >> (64 - 8 * before);
+                continuation += __builtin_popcountll(tails & kept);
+                p += before;
+                break;
+            }
+            continuation += __builtin_popcountll(tails);
+            p += sizeof(word);
+        }
+    }
+#else
+    while (*p != '\0')
+    {
+        continuation += (*p & 0xC0) == 0x80;
+        p++;
+    }
+#endif
+
+    size_t bytes = p - (const unsigned char *) input;
+    return (length) {bytes, bytes - continuation};
+}
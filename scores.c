@@ -1,12 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <cs50.h>
 
-float average(int length, int scores[]);
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define CHUNK_SIZE 65536
+#define MAX_SCORE 100
+
+// Arrays shorter than this are summed on the calling thread alone, and every further thread
+// gets at least this many scores, up to MAX_THREADS threads
+#define PARALLEL_SUM (1 << 16)
+#define MAX_THREADS 256
+
+// Rejected values listed individually; beyond this they are only counted
+#define REPORT_SIZE 10
+
+// Stands in for a value that is not a whole number, so it is rejected like any out of range
+#define MALFORMED INT_MIN
+
+// Running statistics over a stream of scores; scores are whole numbers from 1 to MAX_SCORE,
+// so a histogram gives exact percentiles in constant memory
+typedef struct
+{
+    long count;
+    long sum;
+    double mean;
+    double squares;
+    int min;
+    int max;
+    long histogram[MAX_SCORE + 1];
+}
+stats;
+
+// Values outside 1..MAX_SCORE, with the position (1 for the first value read) of the first few
+typedef struct
+{
+    long count;
+    long positions[REPORT_SIZE];
+    int values[REPORT_SIZE];
+}
+rejections;
+
+// Where the parser stopped inside a value that may continue in the next chunk
+typedef struct
+{
+    long value;
+    bool negative;
+    bool inside;
+    bool digits;
+    bool malformed;
+}
+parser;
+
+// One thread's fixed share of the scores being summed
+typedef struct
+{
+    const int *scores;
+    long length;
+    long sum;
+}
+block;
+
+typedef long (*sum_kernel)(const int *scores, long length);
+typedef size_t (*ingest_kernel)(const int values[], size_t count, int accepted[], long seen, rejections *report);
+
+float average(long length, int scores[]);
+long sum_scores(const int *scores, long length);
+void *sum_block(void *arg);
+void select_kernels(void);
+int *load_scores(FILE *stream, long *length, rejections *report);
+bool stream_scores(FILE *stream, stats *totals, rejections *report);
+void reject_score(rejections *report, long position, int value);
+void print_rejections(const rejections *report);
+size_t parse_scores(parser *state, const char *chunk, size_t length, int values[]);
+void finish_scores(parser *state, int values[], size_t *count);
+void add_scores(stats *totals, const int values[], size_t count);
+int percentile(const stats *totals, int percent);
+void print_stats(const stats *totals);
 
 int n = 3;
+int threads = 1;
+sum_kernel kernel;
+ingest_kernel ingest;
 
-int main(void)
+int main(int argc, string argv[])
 {
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool in_memory = false;
+    int option;
+    while ((option = getopt(argc, argv, "mj:")) != -1)
+    {
+        if (option == 'm')
+        {
+            in_memory = true;
+        }
+        else if (option != 'j' || (threads = atoi(optarg)) < 1)
+        {
+            printf("Usage: ./scores [-m [-j threads]] [file | -]\n");
+            return 1;
+        }
+    }
+    if (argc - optind > 1 || (in_memory && optind == argc))
+    {
+        printf("Usage: ./scores [-m [-j threads]] [file | -]\n");
+        return 1;
+    }
+    select_kernels();
+
+    // Scores from a file or stdin are summarised without being stored, unless -m asks to keep them
+    if (optind < argc)
+    {
+        string path = argv[optind];
+        FILE *stream = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+        if (stream == NULL)
+        {
+            printf("Could not open %s.\n", path);
+            return 1;
+        }
+
+        static stats totals;
+        rejections report = {0};
+        long length = 0;
+        int *scores = NULL;
+        bool read;
+        if (in_memory)
+        {
+            scores = load_scores(stream, &length, &report);
+            read = scores != NULL && !ferror(stream);
+        }
+        else
+        {
+            read = stream_scores(stream, &totals, &report);
+        }
+        if (stream != stdin)
+        {
+            fclose(stream);
+        }
+        if (!read)
+        {
+            printf("Could not read %s.\n", path);
+            return 1;
+        }
+
+        if (in_memory)
+        {
+            printf("Count: %li\n", length);
+            if (length > 0)
+            {
+                printf("Average: %f\n", sum_scores(scores, length) / (double) length);
+            }
+            free(scores);
+        }
+        else
+        {
+            print_stats(&totals);
+        }
+        print_rejections(&report);
+        return 0;
+    }
+
     int scores[n];
 
     for (int i = 0; i < n; i++)
@@ -21,13 +181,373 @@ int main(void)
     printf("Average: %f\n", avg);
 }
 
-float average(int length, int scores[])
+float average(long length, int scores[])
 {
-    int sum = 0;
-    for (int i = 0; i < length; i++)
+    long sum = sum_scores(scores, length);
+    float average = sum / (float) length;
+    return average;
+}
+
+// Splits the scores into one fixed block per thread and adds the block sums in block order.
+// The sums are exact 64-bit integers, so the result never depends on scheduling
+long sum_scores(const int *scores, long length)
+{
+    long parts = threads;
+    parts = parts < length / PARALLEL_SUM + 1 ? parts : length / PARALLEL_SUM + 1;
+    parts = parts < MAX_THREADS ? parts : MAX_THREADS;
+    block *blocks = parts > 1 ? malloc(parts * sizeof(block)) : NULL;
+    pthread_t *workers = parts > 1 ? malloc(parts * sizeof(pthread_t)) : NULL;
+    if (blocks == NULL || workers == NULL)
+    {
+        free(blocks);
+        free(workers);
+        return kernel(scores, length);
+    }
+
+    for (int i = 0; i < parts; i++)
+    {
+        long start = length * i / parts;
+        blocks[i] = (block) {scores + start, length * (i + 1) / parts - start, 0};
+    }
+
+    int started = 1;
+    while (started < parts && pthread_create(&workers[started], NULL, sum_block, &blocks[started]) == 0)
+    {
+        started++;
+    }
+    for (int i = started; i < parts; i++)
+    {
+        sum_block(&blocks[i]);
+    }
+
+    // Block 0 is this thread's share
+    long sum = 0;
+    for (int i = 0; i < parts; i++)
+    {
+        if (i == 0)
+        {
+            sum_block(&blocks[i]);
+        }
+        else if (i < started)
+        {
+            pthread_join(workers[i], NULL);
+        }
+        sum += blocks[i].sum;
+    }
+    free(blocks);
+    free(workers);
+    return sum;
+}
+
+void *sum_block(void *arg)
+{
+    block *part = arg;
+    part->sum = kernel(part->scores, part->length);
+    return NULL;
+}
+
+static long sum_scalar(const int *scores, long length)
+{
+    long sum = 0;
+    for (long i = 0; i < length; i++)
     {
         sum += scores[i];
     }
-    float average = sum / (float) length;
-    return average;
-}
\ No newline at end of file
+    return sum;
+}
+
+#if defined(__x86_64__)
+// Widens eight scores at a time to 64 bits before adding, so no lane can overflow
+__attribute__((target("avx2")))
+static long sum_avx2(const int *scores, long length)
+{
+    __m256i low = _mm256_setzero_si256();
+    __m256i high = _mm256_setzero_si256();
+    long i = 0;
+    for (; i + 8 <= length; i += 8)
+    {
+        __m256i eight = _mm256_loadu_si256((const __m256i *) (scores + i));
+        low = _mm256_add_epi64(low, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(eight)));
+        high = _mm256_add_epi64(high, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(eight, 1)));
+    }
+
+    __m256i both = _mm256_add_epi64(low, high);
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(both), _mm256_extracti128_si256(both, 1));
+    return _mm_cvtsi128_si64(half) + _mm_extract_epi64(half, 1) + sum_scalar(scores + i, length - i);
+}
+#endif
+
+// Copies the values in 1..MAX_SCORE to accepted, in order, and reports the rest. accepted may be
+// values itself, and needs room for 7 values past the accepted ones
+static size_t ingest_scalar(const int values[], size_t count, int accepted[], long seen, rejections *report)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        int value = values[i];
+        bool valid = value > 0 && value <= MAX_SCORE;
+        accepted[kept] = value;
+        kept += valid;
+        if (!valid)
+        {
+            reject_score(report, seen + i + 1, value);
+        }
+    }
+    return kept;
+}
+
+#if defined(__x86_64__)
+// Left-packing permutations: entry m lists the lanes set in the 8-bit mask m, lowest first
+static unsigned char PACK[256][8];
+
+// Checks eight values with two compares, then stores the in-range ones contiguously with one
+// permute; only blocks that contain a rejected value take a branch
+__attribute__((target("avx2,popcnt")))
+static size_t ingest_avx2(const int values[], size_t count, int accepted[], long seen, rejections *report)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i above = _mm256_set1_epi32(MAX_SCORE + 1);
+    size_t kept = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i eight = _mm256_loadu_si256((const __m256i *) (values + i));
+        __m256i valid = _mm256_and_si256(_mm256_cmpgt_epi32(eight, zero), _mm256_cmpgt_epi32(above, eight));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(valid));
+
+        // Reported before the store, which may overwrite these values when accepted is values
+        for (int lanes = ~mask & 0xFF; lanes != 0; lanes &= lanes - 1)
+        {
+            int lane = __builtin_ctz(lanes);
+            reject_score(report, seen + i + lane + 1, values[i + lane]);
+        }
+
+        __m256i order = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) PACK[mask]));
+        _mm256_storeu_si256((__m256i *) (accepted + kept), _mm256_permutevar8x32_epi32(eight, order));
+        kept += __builtin_popcount(mask);
+    }
+    return kept + ingest_scalar(values + i, count - i, accepted + kept, seen + i, report);
+}
+#endif
+
+void select_kernels(void)
+{
+    kernel = sum_scalar;
+    ingest = ingest_scalar;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    {
+        for (int mask = 0; mask < 256; mask++)
+        {
+            int lanes = 0;
+            for (int lane = 0; lane < 8; lane++)
+            {
+                if (mask & (1 << lane))
+                {
+                    PACK[mask][lanes++] = lane;
+                }
+            }
+        }
+        kernel = sum_avx2;
+        ingest = ingest_avx2;
+    }
+#endif
+}
+
+void reject_score(rejections *report, long position, int value)
+{
+    if (report->count < REPORT_SIZE)
+    {
+        report->positions[report->count] = position;
+        report->values[report->count] = value;
+    }
+    report->count++;
+}
+
+void print_rejections(const rejections *report)
+{
+    printf("Rejected: %li\n", report->count);
+    for (int i = 0; i < report->count && i < REPORT_SIZE; i++)
+    {
+        if (report->values[i] == MALFORMED)
+        {
+            printf("  value %li: not a whole number\n", report->positions[i]);
+        }
+        else
+        {
+            printf("  value %li: %i\n", report->positions[i], report->values[i]);
+        }
+    }
+    if (report->count > REPORT_SIZE)
+    {
+        printf("  and %li more\n", report->count - REPORT_SIZE);
+    }
+}
+
+// Reads every score in range into one growing array; the rest are only reported
+int *load_scores(FILE *stream, long *length, rejections *report)
+{
+    static char chunk[CHUNK_SIZE];
+    static int values[CHUNK_SIZE / 2 + 1];
+    long capacity = CHUNK_SIZE;
+    int *scores = malloc(capacity * sizeof(int));
+    if (scores == NULL)
+    {
+        return NULL;
+    }
+
+    parser state = {0};
+    long seen = 0;
+    bool done = false;
+    while (!done)
+    {
+        size_t count = 0;
+        size_t read = fread(chunk, 1, CHUNK_SIZE, stream);
+        if (read > 0)
+        {
+            count = parse_scores(&state, chunk, read, values);
+        }
+        else
+        {
+            finish_scores(&state, values, &count);
+            done = true;
+        }
+
+        if (*length + (long) count + 8 > capacity)
+        {
+            capacity = 2 * capacity + count;
+            int *larger = realloc(scores, capacity * sizeof(int));
+            if (larger == NULL)
+            {
+                free(scores);
+                return NULL;
+            }
+            scores = larger;
+        }
+        *length += ingest(values, count, scores + *length, seen, report);
+        seen += count;
+    }
+    return scores;
+}
+
+// Values are validated in place, so the accepted ones overwrite the chunk's parsed values
+bool stream_scores(FILE *stream, stats *totals, rejections *report)
+{
+    static char chunk[CHUNK_SIZE];
+    static int values[CHUNK_SIZE / 2 + 8];
+    parser state = {0};
+    long seen = 0;
+    size_t length;
+    while ((length = fread(chunk, 1, CHUNK_SIZE, stream)) > 0)
+    {
+        size_t count = parse_scores(&state, chunk, length, values);
+        add_scores(totals, values, ingest(values, count, values, seen, report));
+        seen += count;
+    }
+
+    size_t count = 0;
+    finish_scores(&state, values, &count);
+    add_scores(totals, values, ingest(values, count, values, seen, report));
+    return !ferror(stream);
+}
+
+// Values are separated by whitespace and commas. A value is digits with an optional leading '-';
+// anything else in it (a '.', an 'e', a '-' further in) makes the whole value MALFORMED rather
+// than several values. A value cut off by the end of the chunk is carried over in state
+size_t parse_scores(parser *state, const char *chunk, size_t length, int values[])
+{
+    size_t count = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = chunk[i];
+        unsigned digit = (unsigned char) c - '0';
+        if (digit < 10)
+        {
+            // Anything past four digits is out of range anyway, so stop growing there
+            state->value = state->value < 10000 ? 10 * state->value + digit : state->value;
+            state->digits = true;
+        }
+        else if (c == ' ' || c == ',' || (c >= '\t' && c <= '\r'))
+        {
+            finish_scores(state, values, &count);
+            continue;
+        }
+        else if (c == '-' && !state->inside)
+        {
+            state->negative = true;
+        }
+        else
+        {
+            state->malformed = true;
+        }
+        state->inside = true;
+    }
+    return count;
+}
+
+void finish_scores(parser *state, int values[], size_t *count)
+{
+    if (state->inside)
+    {
+        bool number = state->digits && !state->malformed;
+        values[(*count)++] = !number ? MALFORMED : state->negative ? -state->value : state->value;
+    }
+    *state = (parser) {0};
+}
+
+// Welford's update keeps the variance accurate without summing squares of large totals.
+// Scores must already be in range
+void add_scores(stats *totals, const int values[], size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        int score = values[i];
+        if (totals->count == 0 || score < totals->min)
+        {
+            totals->min = score;
+        }
+        if (totals->count == 0 || score > totals->max)
+        {
+            totals->max = score;
+        }
+        totals->count++;
+        totals->sum += score;
+        totals->histogram[score]++;
+
+        double delta = score - totals->mean;
+        totals->mean += delta / totals->count;
+        totals->squares += delta * (score - totals->mean);
+    }
+}
+
+// Nearest-rank percentile: the smallest score at least percent% of scores do not exceed
+int percentile(const stats *totals, int percent)
+{
+    long rank = (totals->count * percent + 99) / 100;
+    long seen = 0;
+    for (int score = 1; score <= MAX_SCORE; score++)
+    {
+        seen += totals->histogram[score];
+        if (seen >= rank && seen > 0)
+        {
+            return score;
+        }
+    }
+    return 0;
+}
+
+void print_stats(const stats *totals)
+{
+    printf("Count: %li\n", totals->count);
+    if (totals->count > 0)
+    {
+        printf("Average: %f\n", totals->mean);
+        printf("Variance: %f\n", totals->squares / totals->count);
+        printf("Min: %i\n", totals->min);
+        printf("Max: %i\n", totals->max);
+        printf("Median: %i\n", percentile(totals, 50));
+        printf("90th percentile: %i\n", percentile(totals, 90));
+        printf("99th percentile: %i\n", percentile(totals, 99));
+    }
+}